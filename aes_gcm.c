@@ -0,0 +1,479 @@
+#include <string.h>
+#include "aes_gcm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+#define AES_GCM_X86 1
+#endif
+
+static uint8_t sbox[256];
+static uint32_t te[4][256];     // SubBytes + MixColumns per byte position
+static int tables_ready = 0;
+
+static uint8_t rotl8(uint8_t x, int shift) {
+    return (uint8_t)((x << shift) | (x >> (8 - shift)));
+}
+
+static uint32_t rotr32(uint32_t x, int shift) {
+    return (x >> shift) | (x << (32 - shift));
+}
+
+static uint8_t xtime(uint8_t x) {
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0));
+}
+
+// Generates the S-box by walking GF(2^8) with generator 3 and its inverse
+// together, then builds the encryption T-tables from it
+static void init_tables(void) {
+    uint8_t p = 1, q = 1;
+    do {
+        p = p ^ xtime(p);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) q ^= 0x09;
+        sbox[p] = q ^ rotl8(q, 1) ^ rotl8(q, 2) ^ rotl8(q, 3) ^ rotl8(q, 4) ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = sbox[i];
+        uint8_t s2 = xtime(s);
+        uint32_t word = ((uint32_t)s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | (uint8_t)(s2 ^ s);
+        for (int t = 0; t < 4; t++) {
+            te[t][i] = rotr32(word, 8 * t);
+        }
+    }
+    tables_ready = 1;
+}
+
+static uint32_t load_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint64_t load_be64(const uint8_t *p) {
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static void store_be64(uint8_t *p, uint64_t v) {
+    store_be32(p, (uint32_t)(v >> 32));
+    store_be32(p + 4, (uint32_t)v);
+}
+
+static void expand_key(uint8_t *round_keys, const uint8_t key[AES_KEY_SIZE]) {
+    uint8_t rcon = 1;
+    memcpy(round_keys, key, AES_KEY_SIZE);
+    for (int i = 4; i < 4 * (AES_ROUNDS + 1); i++) {
+        uint8_t temp[4];
+        memcpy(temp, round_keys + 4 * (i - 1), 4);
+        if (i % 4 == 0) {
+            uint8_t first = temp[0];
+            temp[0] = sbox[temp[1]] ^ rcon;
+            temp[1] = sbox[temp[2]];
+            temp[2] = sbox[temp[3]];
+            temp[3] = sbox[first];
+            rcon = xtime(rcon);
+        }
+        for (int b = 0; b < 4; b++) {
+            round_keys[4 * i + b] = round_keys[4 * (i - 4) + b] ^ temp[b];
+        }
+    }
+}
+
+static void encrypt_block_soft(const uint8_t *round_keys, const uint8_t in[AES_BLOCK_SIZE],
+                               uint8_t out[AES_BLOCK_SIZE]) {
+    uint32_t s[4], t[4];
+    for (int c = 0; c < 4; c++) {
+        s[c] = load_be32(in + 4 * c) ^ load_be32(round_keys + 4 * c);
+    }
+    for (int round = 1; round < AES_ROUNDS; round++) {
+        const uint8_t *rk = round_keys + round * AES_BLOCK_SIZE;
+        for (int c = 0; c < 4; c++) {
+            t[c] = te[0][s[c] >> 24] ^ te[1][(s[(c + 1) & 3] >> 16) & 0xFF] ^
+                   te[2][(s[(c + 2) & 3] >> 8) & 0xFF] ^ te[3][s[(c + 3) & 3] & 0xFF] ^
+                   load_be32(rk + 4 * c);
+        }
+        memcpy(s, t, sizeof(s));
+    }
+    const uint8_t *rk = round_keys + AES_ROUNDS * AES_BLOCK_SIZE;
+    for (int c = 0; c < 4; c++) {
+        uint32_t word = ((uint32_t)sbox[s[c] >> 24] << 24) |
+                        ((uint32_t)sbox[(s[(c + 1) & 3] >> 16) & 0xFF] << 16) |
+                        ((uint32_t)sbox[(s[(c + 2) & 3] >> 8) & 0xFF] << 8) |
+                        sbox[s[(c + 3) & 3] & 0xFF];
+        store_be32(out + 4 * c, word ^ load_be32(rk + 4 * c));
+    }
+}
+
+// Shoup's 4-bit tables: h_high/h_low[i] hold H times the nibble i
+static void init_ghash_tables(aes_gcm_t *ctx) {
+    uint64_t vh = load_be64(ctx->h);
+    uint64_t vl = load_be64(ctx->h + 8);
+
+    ctx->h_high[0] = ctx->h_low[0] = 0;
+    ctx->h_high[8] = vh;
+    ctx->h_low[8] = vl;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint32_t t = (uint32_t)(vl & 1) * 0xE1000000u;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ ((uint64_t)t << 32);
+        ctx->h_high[i] = vh;
+        ctx->h_low[i] = vl;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            ctx->h_high[i + j] = ctx->h_high[i] ^ ctx->h_high[j];
+            ctx->h_low[i + j] = ctx->h_low[i] ^ ctx->h_low[j];
+        }
+    }
+}
+
+static const uint64_t ghash_reduce[16] = {
+    0x0000, 0x1C20, 0x3840, 0x2460, 0x7080, 0x6CA0, 0x48C0, 0x54E0,
+    0xE100, 0xFD20, 0xD940, 0xC560, 0x9180, 0x8DA0, 0xA9C0, 0xB5E0
+};
+
+// x = x * H in GF(2^128)
+static void ghash_mult_soft(const aes_gcm_t *ctx, uint8_t x[AES_BLOCK_SIZE]) {
+    uint8_t nibble = x[15] & 0x0F;
+    uint64_t zh = ctx->h_high[nibble];
+    uint64_t zl = ctx->h_low[nibble];
+
+    for (int i = 15; i >= 0; i--) {
+        uint8_t low = x[i] & 0x0F;
+        uint8_t high = x[i] >> 4;
+        uint8_t rem;
+        if (i != 15) {
+            rem = (uint8_t)(zl & 0x0F);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (ghash_reduce[rem] << 48);
+            zh ^= ctx->h_high[low];
+            zl ^= ctx->h_low[low];
+        }
+        rem = (uint8_t)(zl & 0x0F);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (ghash_reduce[rem] << 48);
+        zh ^= ctx->h_high[high];
+        zl ^= ctx->h_low[high];
+    }
+    store_be64(x, zh);
+    store_be64(x + 8, zl);
+}
+
+static void ghash_soft(const aes_gcm_t *ctx, uint8_t x[AES_BLOCK_SIZE], const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = len < AES_BLOCK_SIZE ? len : AES_BLOCK_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            x[i] ^= data[i];
+        }
+        ghash_mult_soft(ctx, x);
+        data += n;
+        len -= n;
+    }
+}
+
+static void increment_counter(uint8_t counter[AES_BLOCK_SIZE]) {
+    store_be32(counter + 12, load_be32(counter + 12) + 1);
+}
+
+static void ctr_soft(const aes_gcm_t *ctx, uint8_t counter[AES_BLOCK_SIZE], uint8_t *data, size_t len) {
+    uint8_t keystream[AES_BLOCK_SIZE];
+    while (len > 0) {
+        size_t n = len < AES_BLOCK_SIZE ? len : AES_BLOCK_SIZE;
+        encrypt_block_soft(ctx->round_keys, counter, keystream);
+        increment_counter(counter);
+        for (size_t i = 0; i < n; i++) {
+            data[i] ^= keystream[i];
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+#ifdef AES_GCM_X86
+// Compiled for AES-NI, PCLMULQDQ and SSSE3 on their own so the rest of the
+// program keeps the baseline instruction set; only used after the CPU check
+
+#define HW_TARGET __attribute__((target("aes,pclmul,ssse3")))
+
+HW_TARGET
+static __m128i byte_swap(__m128i x) {
+    return _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+HW_TARGET
+static __m128i encrypt_block_hw(const __m128i *rk, __m128i block) {
+    block = _mm_xor_si128(block, rk[0]);
+    for (int round = 1; round < AES_ROUNDS; round++) {
+        block = _mm_aesenc_si128(block, rk[round]);
+    }
+    return _mm_aesenclast_si128(block, rk[AES_ROUNDS]);
+}
+
+// Carry-less multiply and reduce on byte-swapped operands (Gueron and
+// Kounavis, "Intel Carry-Less Multiplication Instruction and its Usage for
+// Computing the GCM Mode", algorithm 5). The 256-bit product is left
+// unreduced so several can be summed before one reduction.
+HW_TARGET
+static void clmul_wide(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    *lo = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x00), _mm_slli_si128(mid, 8));
+    *hi = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x11), _mm_srli_si128(mid, 8));
+}
+
+HW_TARGET
+static __m128i gf_reduce(__m128i lo, __m128i hi) {
+    // Shift the 256-bit product left by one for the bit-reflected operands
+    __m128i lo_carry = _mm_srli_epi32(lo, 31);
+    __m128i hi_carry = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    __m128i cross = _mm_srli_si128(lo_carry, 12);
+    hi_carry = _mm_slli_si128(hi_carry, 4);
+    lo_carry = _mm_slli_si128(lo_carry, 4);
+    lo = _mm_or_si128(lo, lo_carry);
+    hi = _mm_or_si128(_mm_or_si128(hi, hi_carry), cross);
+
+    // Reduce modulo x^128 + x^7 + x^2 + x + 1
+    __m128i t = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)),
+                              _mm_slli_epi32(lo, 25));
+    __m128i t_high = _mm_srli_si128(t, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+    __m128i u = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)),
+                              _mm_srli_epi32(lo, 7));
+    u = _mm_xor_si128(u, t_high);
+    lo = _mm_xor_si128(lo, u);
+    return _mm_xor_si128(hi, lo);
+}
+
+HW_TARGET
+static __m128i gf_mult_hw(__m128i a, __m128i b) {
+    __m128i lo, hi;
+    clmul_wide(a, b, &lo, &hi);
+    return gf_reduce(lo, hi);
+}
+
+HW_TARGET
+static void init_h_powers(aes_gcm_t *ctx) {
+    __m128i h = byte_swap(_mm_loadu_si128((const __m128i*)ctx->h));
+    __m128i power = h;
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i*)ctx->h_powers[i], power);
+        power = gf_mult_hw(power, h);
+    }
+}
+
+// Four blocks per reduction: X' = (X + B0)H^4 + B1 H^3 + B2 H^2 + B3 H,
+// which takes the multiply latency off the block-to-block dependency
+HW_TARGET
+static void ghash_hw(const aes_gcm_t *ctx, uint8_t x[AES_BLOCK_SIZE], const uint8_t *data, size_t len) {
+    __m128i h1 = _mm_loadu_si128((const __m128i*)ctx->h_powers[0]);
+    __m128i h2 = _mm_loadu_si128((const __m128i*)ctx->h_powers[1]);
+    __m128i h3 = _mm_loadu_si128((const __m128i*)ctx->h_powers[2]);
+    __m128i h4 = _mm_loadu_si128((const __m128i*)ctx->h_powers[3]);
+    __m128i acc = byte_swap(_mm_loadu_si128((const __m128i*)x));
+
+    for (; len >= 4 * AES_BLOCK_SIZE; data += 4 * AES_BLOCK_SIZE, len -= 4 * AES_BLOCK_SIZE) {
+        const __m128i *blocks = (const __m128i*)data;
+        __m128i lo, hi, lo_part, hi_part;
+        clmul_wide(_mm_xor_si128(acc, byte_swap(_mm_loadu_si128(blocks))), h4, &lo, &hi);
+        clmul_wide(byte_swap(_mm_loadu_si128(blocks + 1)), h3, &lo_part, &hi_part);
+        lo = _mm_xor_si128(lo, lo_part);
+        hi = _mm_xor_si128(hi, hi_part);
+        clmul_wide(byte_swap(_mm_loadu_si128(blocks + 2)), h2, &lo_part, &hi_part);
+        lo = _mm_xor_si128(lo, lo_part);
+        hi = _mm_xor_si128(hi, hi_part);
+        clmul_wide(byte_swap(_mm_loadu_si128(blocks + 3)), h1, &lo_part, &hi_part);
+        lo = _mm_xor_si128(lo, lo_part);
+        hi = _mm_xor_si128(hi, hi_part);
+        acc = gf_reduce(lo, hi);
+    }
+    for (; len >= AES_BLOCK_SIZE; data += AES_BLOCK_SIZE, len -= AES_BLOCK_SIZE) {
+        __m128i block = byte_swap(_mm_loadu_si128((const __m128i*)data));
+        acc = gf_mult_hw(_mm_xor_si128(acc, block), h1);
+    }
+    if (len > 0) {
+        uint8_t last[AES_BLOCK_SIZE] = {0};
+        memcpy(last, data, len);
+        __m128i block = byte_swap(_mm_loadu_si128((const __m128i*)last));
+        acc = gf_mult_hw(_mm_xor_si128(acc, block), h1);
+    }
+    _mm_storeu_si128((__m128i*)x, byte_swap(acc));
+}
+
+// Four counter blocks per iteration keep the AES units busy; the counter is
+// held byte-swapped so its 32-bit increment is a single lane add
+HW_TARGET
+static void ctr_hw(const aes_gcm_t *ctx, uint8_t counter[AES_BLOCK_SIZE], uint8_t *data, size_t len) {
+    __m128i rk[AES_ROUNDS + 1];
+    for (int i = 0; i <= AES_ROUNDS; i++) {
+        rk[i] = _mm_loadu_si128((const __m128i*)(ctx->round_keys + i * AES_BLOCK_SIZE));
+    }
+    __m128i ctr = byte_swap(_mm_loadu_si128((const __m128i*)counter));
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+
+    for (; len >= 4 * AES_BLOCK_SIZE; data += 4 * AES_BLOCK_SIZE, len -= 4 * AES_BLOCK_SIZE) {
+        __m128i b0 = byte_swap(ctr);
+        ctr = _mm_add_epi32(ctr, one);
+        __m128i b1 = byte_swap(ctr);
+        ctr = _mm_add_epi32(ctr, one);
+        __m128i b2 = byte_swap(ctr);
+        ctr = _mm_add_epi32(ctr, one);
+        __m128i b3 = byte_swap(ctr);
+        ctr = _mm_add_epi32(ctr, one);
+
+        b0 = _mm_xor_si128(b0, rk[0]);
+        b1 = _mm_xor_si128(b1, rk[0]);
+        b2 = _mm_xor_si128(b2, rk[0]);
+        b3 = _mm_xor_si128(b3, rk[0]);
+        for (int round = 1; round < AES_ROUNDS; round++) {
+            b0 = _mm_aesenc_si128(b0, rk[round]);
+            b1 = _mm_aesenc_si128(b1, rk[round]);
+            b2 = _mm_aesenc_si128(b2, rk[round]);
+            b3 = _mm_aesenc_si128(b3, rk[round]);
+        }
+        b0 = _mm_aesenclast_si128(b0, rk[AES_ROUNDS]);
+        b1 = _mm_aesenclast_si128(b1, rk[AES_ROUNDS]);
+        b2 = _mm_aesenclast_si128(b2, rk[AES_ROUNDS]);
+        b3 = _mm_aesenclast_si128(b3, rk[AES_ROUNDS]);
+
+        __m128i *block = (__m128i*)data;
+        _mm_storeu_si128(block, _mm_xor_si128(_mm_loadu_si128(block), b0));
+        _mm_storeu_si128(block + 1, _mm_xor_si128(_mm_loadu_si128(block + 1), b1));
+        _mm_storeu_si128(block + 2, _mm_xor_si128(_mm_loadu_si128(block + 2), b2));
+        _mm_storeu_si128(block + 3, _mm_xor_si128(_mm_loadu_si128(block + 3), b3));
+    }
+
+    while (len > 0) {
+        uint8_t keystream[AES_BLOCK_SIZE];
+        _mm_storeu_si128((__m128i*)keystream, encrypt_block_hw(rk, byte_swap(ctr)));
+        ctr = _mm_add_epi32(ctr, one);
+        size_t n = len < AES_BLOCK_SIZE ? len : AES_BLOCK_SIZE;
+        for (size_t i = 0; i < n; i++) {
+            data[i] ^= keystream[i];
+        }
+        data += n;
+        len -= n;
+    }
+    _mm_storeu_si128((__m128i*)counter, byte_swap(ctr));
+}
+#endif
+
+int aes_gcm_hardware_available(void) {
+#ifdef AES_GCM_X86
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul") &&
+           __builtin_cpu_supports("ssse3");
+#else
+    return 0;
+#endif
+}
+
+void aes_gcm_init(aes_gcm_t *ctx, const uint8_t key[AES_KEY_SIZE], int allow_hardware) {
+    if (!tables_ready) {
+        init_tables();
+    }
+    memset(ctx, 0, sizeof(aes_gcm_t));
+    expand_key(ctx->round_keys, key);
+    ctx->hardware = allow_hardware && aes_gcm_hardware_available();
+
+    uint8_t zero[AES_BLOCK_SIZE] = {0};
+    encrypt_block_soft(ctx->round_keys, zero, ctx->h);
+    init_ghash_tables(ctx);
+#ifdef AES_GCM_X86
+    if (ctx->hardware) {
+        init_h_powers(ctx);
+    }
+#endif
+}
+
+const char *aes_gcm_implementation(const aes_gcm_t *ctx) {
+    return ctx->hardware ? "aesni" : "table";
+}
+
+void aes_encrypt_block(const aes_gcm_t *ctx, const uint8_t in[AES_BLOCK_SIZE],
+                       uint8_t out[AES_BLOCK_SIZE]) {
+    encrypt_block_soft(ctx->round_keys, in, out);
+}
+
+static void ghash(const aes_gcm_t *ctx, uint8_t x[AES_BLOCK_SIZE], const uint8_t *data, size_t len) {
+#ifdef AES_GCM_X86
+    if (ctx->hardware) {
+        ghash_hw(ctx, x, data, len);
+        return;
+    }
+#endif
+    ghash_soft(ctx, x, data, len);
+}
+
+static void ctr_crypt(const aes_gcm_t *ctx, uint8_t counter[AES_BLOCK_SIZE], uint8_t *data, size_t len) {
+#ifdef AES_GCM_X86
+    if (ctx->hardware) {
+        ctr_hw(ctx, counter, data, len);
+        return;
+    }
+#endif
+    ctr_soft(ctx, counter, data, len);
+}
+
+// GHASH over aad and ciphertext and their bit lengths, masked with E(K, J0)
+static void compute_tag(const aes_gcm_t *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                        const uint8_t *aad, size_t aad_len, const uint8_t *data, size_t len,
+                        uint8_t tag[AES_GCM_TAG_SIZE]) {
+    uint8_t x[AES_BLOCK_SIZE] = {0};
+    ghash(ctx, x, aad, aad_len);
+    ghash(ctx, x, data, len);
+
+    uint8_t lengths[AES_BLOCK_SIZE];
+    store_be64(lengths, (uint64_t)aad_len * 8);
+    store_be64(lengths + 8, (uint64_t)len * 8);
+    ghash(ctx, x, lengths, sizeof(lengths));
+
+    uint8_t j0[AES_BLOCK_SIZE];
+    memcpy(j0, iv, AES_GCM_IV_SIZE);
+    store_be32(j0 + 12, 1);
+    uint8_t mask[AES_BLOCK_SIZE];
+    encrypt_block_soft(ctx->round_keys, j0, mask);
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        tag[i] = x[i] ^ mask[i];
+    }
+}
+
+void aes_gcm_encrypt(const aes_gcm_t *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                     const uint8_t *aad, size_t aad_len, uint8_t *data, size_t len,
+                     uint8_t tag[AES_GCM_TAG_SIZE]) {
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_GCM_IV_SIZE);
+    store_be32(counter + 12, 2);
+    ctr_crypt(ctx, counter, data, len);
+    compute_tag(ctx, iv, aad, aad_len, data, len, tag);
+}
+
+int aes_gcm_decrypt(const aes_gcm_t *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                    const uint8_t *aad, size_t aad_len, uint8_t *data, size_t len,
+                    const uint8_t tag[AES_GCM_TAG_SIZE]) {
+    uint8_t expected[AES_GCM_TAG_SIZE];
+    compute_tag(ctx, iv, aad, aad_len, data, len, expected);
+
+    // Constant time, so the comparison does not reveal how much matched
+    uint8_t diff = 0;
+    for (int i = 0; i < AES_GCM_TAG_SIZE; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff != 0) {
+        return -1;
+    }
+
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, iv, AES_GCM_IV_SIZE);
+    store_be32(counter + 12, 2);
+    ctr_crypt(ctx, counter, data, len);
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef AES_GCM_H
+#define AES_GCM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AES_KEY_SIZE 16         // AES-128 only, as in AEAD_AES_128_GCM
+#define AES_BLOCK_SIZE 16
+#define AES_ROUNDS 10
+#define AES_GCM_IV_SIZE 12
+#define AES_GCM_TAG_SIZE 16
+
+// AES-128-GCM with a 96-bit IV. Uses AES-NI and PCLMULQDQ when the CPU has
+// them, otherwise T-table AES and 4-bit table GHASH (both faster than a
+// byte-wise implementation but not constant-time, so prefer hardware).
+typedef struct {
+    uint8_t round_keys[(AES_ROUNDS + 1) * AES_BLOCK_SIZE];
+    uint8_t h[AES_BLOCK_SIZE];      // hash subkey, E(K, 0)
+    uint64_t h_high[16];            // software GHASH: multiples of H by each nibble
+    uint64_t h_low[16];
+    uint8_t h_powers[4][AES_BLOCK_SIZE];   // hardware GHASH: H^1..H^4, byte-swapped
+    int hardware;
+} aes_gcm_t;
+
+int aes_gcm_hardware_available(void);
+
+// allow_hardware 0 forces the software path, for comparison
+void aes_gcm_init(aes_gcm_t *ctx, const uint8_t key[AES_KEY_SIZE], int allow_hardware);
+
+const char *aes_gcm_implementation(const aes_gcm_t *ctx);
+
+// Encrypts data in place and writes the tag over aad and ciphertext
+void aes_gcm_encrypt(const aes_gcm_t *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                     const uint8_t *aad, size_t aad_len, uint8_t *data, size_t len,
+                     uint8_t tag[AES_GCM_TAG_SIZE]);
+
+// Checks the tag first and only then decrypts in place, so a forged packet
+// costs one GHASH pass and its buffer is left untouched. Returns -1 if the
+// tag does not match.
+int aes_gcm_decrypt(const aes_gcm_t *ctx, const uint8_t iv[AES_GCM_IV_SIZE],
+                    const uint8_t *aad, size_t aad_len, uint8_t *data, size_t len,
+                    const uint8_t tag[AES_GCM_TAG_SIZE]);
+
+// Single-block AES-128 encryption with the context's key (used for the
+// SRTP key derivation's counter mode)
+void aes_encrypt_block(const aes_gcm_t *ctx, const uint8_t in[AES_BLOCK_SIZE],
+                       uint8_t out[AES_BLOCK_SIZE]);
+
+#endif // AES_GCM_H
@@ -0,0 +1,142 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "arena.h"
+
+static size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// Anonymous mapping aligned to a hugepage boundary, so transparent
+// hugepages can back it from the first byte: over-map, then trim both ends
+static uint8_t *map_aligned(size_t size) {
+    size_t mapped = size + ARENA_HUGEPAGE_SIZE;
+    uint8_t *raw = (uint8_t*)mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    uint8_t *base = (uint8_t*)round_up((uintptr_t)raw, ARENA_HUGEPAGE_SIZE);
+    size_t head = (size_t)(base - raw);
+    if (head > 0) munmap(raw, head);
+    if (mapped - head > size) munmap(base + size, mapped - head - size);
+    return base;
+}
+
+int init_arena(arena_t *arena, size_t size, arena_pages_t pages, int lock) {
+    memset(arena, 0, sizeof(arena_t));
+    size = round_up(size > 0 ? size : 1, ARENA_HUGEPAGE_SIZE);
+
+    uint8_t *base = NULL;
+    if (pages == ARENA_PAGES_EXPLICIT) {
+        base = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED) {
+            printf("Warning: no %zu MB of explicit hugepages (%s, see /proc/sys/vm/nr_hugepages), "
+                   "using transparent hugepages\n", size >> 20, strerror(errno));
+            base = NULL;
+            pages = ARENA_PAGES_TRANSPARENT;
+        }
+    }
+    if (!base) {
+        base = map_aligned(size);
+        if (!base) {
+            perror("Arena mapping failed");
+            return -1;
+        }
+    }
+    if (pages == ARENA_PAGES_TRANSPARENT && madvise(base, size, MADV_HUGEPAGE) < 0) {
+        printf("Warning: transparent hugepages unavailable (%s)\n", strerror(errno));
+        pages = ARENA_PAGES_NORMAL;
+    }
+
+    arena->base = base;
+    arena->size = size;
+    arena->pages = pages;
+
+    // Faults every page in now rather than on the first packets
+    if (lock) {
+        if (mlock(base, size) == 0) {
+            arena->locked = 1;
+        } else {
+            printf("Warning: could not lock %zu MB arena in memory (%s, see ulimit -l)\n",
+                   size >> 20, strerror(errno));
+        }
+    }
+    return 0;
+}
+
+void free_arena(arena_t *arena) {
+    if (arena->base) {
+        if (arena->locked) munlock(arena->base, arena->size);
+        munmap(arena->base, arena->size);
+    }
+    memset(arena, 0, sizeof(arena_t));
+}
+
+void *arena_alloc(arena_t *arena, size_t size) {
+    if (!arena) {
+        return malloc(size);
+    }
+    size_t aligned = round_up(size > 0 ? size : 1, ARENA_ALIGN);
+    if (!arena->base || arena->size - arena->used < aligned) {
+        arena->heap_fallbacks++;
+        return malloc(size);
+    }
+    void *ptr = arena->base + arena->used;
+    arena->used += aligned;
+    return ptr;
+}
+
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size) {
+    if (!arena || !arena->base) {
+        return realloc(ptr, size);
+    }
+    void *grown = arena_alloc(arena, size);
+    if (grown && ptr) {
+        memcpy(grown, ptr, old_size < size ? old_size : size);
+        arena_release(arena, ptr);
+    }
+    return grown;
+}
+
+void arena_release(arena_t *arena, void *ptr) {
+    if (!arena_owns(arena, ptr)) {
+        free(ptr);
+    }
+}
+
+int arena_owns(const arena_t *arena, const void *ptr) {
+    return arena && arena->base && (const uint8_t*)ptr >= arena->base &&
+           (const uint8_t*)ptr < arena->base + arena->size;
+}
+
+int arena_parse_pages(const char *text, arena_pages_t *pages) {
+    if (strcmp(text, "off") == 0) {
+        *pages = ARENA_PAGES_NORMAL;
+    } else if (strcmp(text, "transparent") == 0) {
+        *pages = ARENA_PAGES_TRANSPARENT;
+    } else if (strcmp(text, "explicit") == 0) {
+        *pages = ARENA_PAGES_EXPLICIT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+const char *arena_pages_name(arena_pages_t pages) {
+    switch (pages) {
+    case ARENA_PAGES_TRANSPARENT: return "transparent hugepages";
+    case ARENA_PAGES_EXPLICIT: return "explicit hugepages";
+    default: return "normal pages";
+    }
+}
+
+void print_arena(const arena_t *arena, const char *name) {
+    printf("%s arena: %.1f of %zu MB used, %s%s, %d heap fallbacks\n", name,
+           arena->used / 1048576.0, arena->size >> 20, arena_pages_name(arena->pages),
+           arena->locked ? ", locked" : "", arena->heap_fallbacks);
+}
@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_ALIGN 64                      // cache line, so no two buffers share one
+#define ARENA_HUGEPAGE_SIZE (2u * 1024 * 1024)
+
+typedef enum {
+    ARENA_PAGES_NORMAL,
+    ARENA_PAGES_TRANSPARENT,    // madvise(MADV_HUGEPAGE), kernel backs it when it can
+    ARENA_PAGES_EXPLICIT        // MAP_HUGETLB from the reserved hugepage pool
+} arena_pages_t;
+
+// One mapping that packet and frame buffers are carved from, so the
+// per-packet path touches a few contiguous (ideally huge) pages instead of
+// scattered heap blocks, and steady-state streaming never calls malloc.
+// Allocation only bumps a pointer; nothing is returned until free_arena.
+//
+// Every function also takes a NULL arena, which means the plain heap, and
+// an allocation that no longer fits falls back to the heap too, so callers
+// never need to know where a buffer came from. Release them all through
+// arena_release.
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    arena_pages_t pages;        // what the mapping actually got
+    int locked;
+    int heap_fallbacks;         // allocations that did not fit
+} arena_t;
+
+// Maps `size` bytes (rounded up to whole hugepages), falling back from
+// explicit to transparent hugepages when the pool is empty. With lock the
+// whole mapping is faulted in and mlock'd up front; if RLIMIT_MEMLOCK is
+// too low that is reported and the arena stays unlocked. Returns -1 only
+// if the mapping itself fails.
+int init_arena(arena_t *arena, size_t size, arena_pages_t pages, int lock);
+void free_arena(arena_t *arena);
+
+void *arena_alloc(arena_t *arena, size_t size);
+
+// Carves a new block and copies old_size bytes over. The old block is only
+// reclaimed if it came from the heap, so grow buffers rarely.
+void *arena_realloc(arena_t *arena, void *ptr, size_t old_size, size_t size);
+
+// Frees heap blocks; arena blocks are reclaimed by free_arena
+void arena_release(arena_t *arena, void *ptr);
+
+int arena_owns(const arena_t *arena, const void *ptr);
+
+// Parses "off", "transparent" or "explicit"; returns -1 otherwise
+int arena_parse_pages(const char *text, arena_pages_t *pages);
+const char *arena_pages_name(arena_pages_t pages);
+
+void print_arena(const arena_t *arena, const char *name);
+
+#endif // ARENA_H
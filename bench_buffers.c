@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include "rtp.h"
+#include "jitter_buffer.h"
+#include "reorder_buffer.h"
+#include "playout_buffer.h"
+#include "nack_buffer.h"
+#include "playout_clock.h"
+#include "seq_tracker.h"
+#include "bench_utils.h"
+#include "time_utils.h"
+#include "buffer_config.h"
+#include "arena.h"
+
+#define TRACE_LENGTH 20000
+#define BENCH_PAYLOAD_SIZE 1400
+#define REORDER_BATCH 32
+#define NACK_TIMEOUT_CALLS 2000
+#define GAP_NACK_LIMIT 100 // same gap window the client uses before NACKing
+#define PIPELINE_INTERVAL_US 100 // 10k packets/s, about 110 Mbit/s of full packets
+#define PIPELINE_FLUSH_MS 100
+// The bitrate the pipeline's buffers are sized for, as the client would be
+#define PIPELINE_BITRATE_KBPS (1000000 / PIPELINE_INTERVAL_US * BUFFER_SIZING_DATAGRAM * 8 / 1000)
+#define PIPELINE_FRAME_PACKETS 20 // packets per frame, for the RTP timestamps
+
+typedef enum {
+    TRACE_IN_ORDER,
+    TRACE_REORDERED,
+    TRACE_BURSTY_LOSS,
+    TRACE_WRAPAROUND,
+    TRACE_COUNT
+} trace_type_t;
+
+static const char *trace_names[TRACE_COUNT] = {
+    "in_order", "reordered", "bursty_loss", "wraparound"
+};
+
+// Where the jitter and reorder slots live. The minimum capacities fit in a
+// few pages whatever backs them; buffers sized for 1 Gbit/s span megabytes,
+// where carving them from a hugepage arena saves TLB misses per packet.
+typedef struct {
+    const char *suffix;         // appended to the suite name
+    uint32_t bitrate_kbps;      // capacities as the client sizes them, 0 for the minimum
+    int arena;
+} memory_config_t;
+
+static const memory_config_t memory_configs[] = {
+    {"", 0, 0},
+    {"_1g_heap", 1000000, 0},
+    {"_1g_arena", 1000000, 1},
+};
+
+// Arrival order of sequence numbers, plus which ones never arrive
+typedef struct {
+    uint16_t seqs[TRACE_LENGTH];
+    uint64_t ext_seqs[TRACE_LENGTH];  // as the receiver extends them on arrival
+    size_t count;
+    uint8_t lost[65536];
+} trace_t;
+
+static uint32_t rng_state = 0x2545F491;
+
+static uint32_t next_random(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int chance(double probability) {
+    return (next_random() / 4294967296.0) < probability;
+}
+
+static void build_trace(trace_t *trace, trace_type_t type, uint32_t seed) {
+    memset(trace, 0, sizeof(trace_t));
+    // xorshift never leaves zero, so a zero seed would lose every packet
+    rng_state = seed ? seed : 0x2545F491;
+
+    uint16_t start = (type == TRACE_WRAPAROUND) ? (uint16_t)(65535 - TRACE_LENGTH / 2) : 0;
+    int bad_state = 0;
+
+    for (size_t i = 0; i < TRACE_LENGTH; i++) {
+        uint16_t seq = (uint16_t)(start + i);
+
+        if (type == TRACE_BURSTY_LOSS) {
+            // Gilbert-Elliott: short bursts of consecutive drops
+            bad_state = bad_state ? !chance(0.3) : chance(0.02);
+            if (bad_state) {
+                trace->lost[seq] = 1;
+                continue;
+            }
+        }
+        trace->seqs[trace->count++] = seq;
+    }
+
+    if (type == TRACE_REORDERED) {
+        // Displace ~10% of packets by up to 3 positions
+        for (size_t i = 0; i + 3 < trace->count; i++) {
+            if (chance(0.1)) {
+                size_t j = i + 1 + next_random() % 3;
+                uint16_t tmp = trace->seqs[i];
+                trace->seqs[i] = trace->seqs[j];
+                trace->seqs[j] = tmp;
+            }
+        }
+    }
+
+    seq_tracker_t tracker;
+    init_seq_tracker(&tracker);
+    for (size_t i = 0; i < trace->count; i++) {
+        trace->ext_seqs[i] = seq_tracker_update(&tracker, trace->seqs[i]);
+    }
+}
+
+static void make_packet(rtp_packet_t *packet, uint16_t seq) {
+    init_rtp_header(&packet->header, seq, 1000, 0x12345678);
+    memset(packet->payload, seq & 0xFF, BENCH_PAYLOAD_SIZE);
+}
+
+// Push every buffered packet past JITTER_DELAY_MS so it is due immediately
+static void age_jitter_buffer(jitter_buffer_t *jb) {
+    for (int i = 0; i < jb->capacity; i++) {
+        if (jb->buffer[i].valid) {
+            jb->buffer[i].arrival_time.tv_sec -= 1;
+        }
+    }
+}
+
+static void init_memory(const memory_config_t *mem, buffer_config_t *sizes, arena_t *arena) {
+    init_buffer_config(sizes);
+    if (mem->bitrate_kbps > 0) {
+        sizes->bitrate_kbps = mem->bitrate_kbps;
+        buffer_config_size(sizes);
+    } else {
+        sizes->jitter_packets = JITTER_BUFFER_SIZE;
+        sizes->reorder_packets = REORDER_BUFFER_SIZE;
+    }
+    if (mem->arena) {
+        size_t slots = (size_t)sizes->jitter_packets + (size_t)sizes->reorder_packets;
+        init_arena(arena, slots * JITTER_SLOT_SIZE, ARENA_PAGES_TRANSPARENT, 0);
+    }
+}
+
+// Cycles a packet through every jitter slot before timing, so slots are
+// carved and their pages faulted in as they would be in steady state
+static void warm_jitter_buffer(jitter_buffer_t *jb, rtp_packet_t *packet, size_t packet_size) {
+    size_t size;
+    for (int i = 0; i < jb->capacity; i++) {
+        jitter_buffer_add(jb, packet, packet_size);
+        jb->buffer[jb->tail].arrival_time.tv_sec -= 1;
+        jitter_buffer_get(jb, &size);
+    }
+}
+
+static void bench_jitter(FILE *out, trace_t *trace, const char *trace_name,
+                         const memory_config_t *mem) {
+    static jitter_buffer_t jb;
+    static rtp_packet_t packets[JITTER_BUFFER_SIZE];
+    bench_timer_t add_timer, get_timer;
+    bench_timer_init(&add_timer);
+    bench_timer_init(&get_timer);
+    uint64_t adds = 0, gets = 0;
+
+    buffer_config_t sizes;
+    arena_t arena;
+    init_memory(mem, &sizes, &arena);
+    init_jitter_buffer(&jb, sizes.jitter_packets, mem->arena ? &arena : NULL);
+    size_t packet_size = sizeof(rtp_header_t) + BENCH_PAYLOAD_SIZE;
+    make_packet(&packets[0], 0);
+    warm_jitter_buffer(&jb, &packets[0], packet_size);
+
+    for (size_t i = 0; i < trace->count; ) {
+        size_t batch_end = i + JITTER_BUFFER_SIZE;
+        if (batch_end > trace->count) batch_end = trace->count;
+
+        size_t batch_count = batch_end - i;
+
+        for (size_t j = 0; j < batch_count; j++) {
+            make_packet(&packets[j], trace->seqs[i + j]);
+        }
+
+        bench_timer_start(&add_timer);
+        for (size_t j = 0; j < batch_count; j++) {
+            jitter_buffer_add(&jb, &packets[j], packet_size);
+        }
+        bench_timer_stop(&add_timer);
+        adds += batch_count;
+        i = batch_end;
+
+        age_jitter_buffer(&jb);
+
+        size_t size;
+        bench_timer_start(&get_timer);
+        while (jitter_buffer_get(&jb, &size) != NULL) {
+            gets++;
+        }
+        bench_timer_stop(&get_timer);
+    }
+
+    free_jitter_buffer(&jb);
+    if (mem->arena) free_arena(&arena);
+
+    char suite[32];
+    snprintf(suite, sizeof(suite), "jitter%s", mem->suffix);
+    bench_report(out, suite, "add", trace_name, adds, &add_timer);
+    bench_report(out, suite, "get", trace_name, gets, &get_timer);
+    bench_timer_close(&add_timer);
+    bench_timer_close(&get_timer);
+}
+
+// Fills and drains every reorder slot before timing, like warm_jitter_buffer
+static void warm_reorder_buffer(reorder_buffer_t *rb, uint8_t *payload) {
+    size_t size;
+    for (int i = 0; i < rb->capacity; i++) {
+        insert_packet(rb, (uint64_t)i, payload, BENCH_PAYLOAD_SIZE);
+    }
+    while (get_next_packet(rb, &size, NULL) != NULL) {
+    }
+    reset_reorder_buffer(rb);
+}
+
+static void bench_reorder(FILE *out, trace_t *trace, const char *trace_name,
+                          const memory_config_t *mem) {
+    static reorder_buffer_t rb;
+    static uint8_t payload[BENCH_PAYLOAD_SIZE];
+    bench_timer_t insert_timer, next_timer;
+    bench_timer_init(&insert_timer);
+    bench_timer_init(&next_timer);
+    uint64_t inserts = 0, nexts = 0;
+    stats_t stats;
+    init_stats(&stats);
+
+    buffer_config_t sizes;
+    arena_t arena;
+    init_memory(mem, &sizes, &arena);
+    init_reorder_buffer(&rb, sizes.reorder_packets, mem->arena ? &arena : NULL);
+    warm_reorder_buffer(&rb, payload);
+
+    for (size_t i = 0; i < trace->count; ) {
+        size_t batch_end = i + REORDER_BATCH;
+        if (batch_end > trace->count) batch_end = trace->count;
+
+        inserts += batch_end - i;
+
+        bench_timer_start(&insert_timer);
+        for (; i < batch_end; i++) {
+            insert_packet(&rb, trace->ext_seqs[i], payload, BENCH_PAYLOAD_SIZE);
+        }
+        bench_timer_stop(&insert_timer);
+
+        // Drain in order; expire the wait immediately for packets the
+        // trace dropped instead of sleeping NEXT_PACKET_WAIT_MS, once a
+        // later packet shows the gap (else the next batch will)
+        size_t size;
+        bench_timer_start(&next_timer);
+        while (1) {
+            if (get_next_packet(&rb, &size, &stats) != NULL) {
+                nexts++;
+                continue;
+            }
+            if (!trace->lost[(uint16_t)rb.expected_seq] || rb.highest_seq <= rb.expected_seq) break;
+            rb.packet_wait_time.tv_sec -= 1;
+        }
+        bench_timer_stop(&next_timer);
+    }
+    free_reorder_buffer(&rb);
+    if (mem->arena) free_arena(&arena);
+
+    char suite[32];
+    snprintf(suite, sizeof(suite), "reorder%s", mem->suffix);
+    bench_report(out, suite, "insert_packet", trace_name, inserts, &insert_timer);
+    bench_report(out, suite, "get_next_packet", trace_name, nexts, &next_timer);
+    bench_timer_close(&insert_timer);
+    bench_timer_close(&next_timer);
+}
+
+// Arrivals on a virtual clock for the whole receive path, one packet every
+// PIPELINE_INTERVAL_US in trace order, so the time a packet is held can be
+// measured without sleeping
+typedef struct {
+    struct timeval clock;
+    uint64_t now_us;
+    uint64_t arrival_us[65536];     // by 16-bit sequence number
+    uint64_t ext_seqs[65536];
+    uint64_t released;
+    uint64_t held_us;               // summed from arrival to release
+} pipeline_run_t;
+
+static void pipeline_set_clock(pipeline_run_t *run, uint64_t us) {
+    run->now_us = us;
+    run->clock.tv_sec = (time_t)(1000 + us / 1000000);
+    run->clock.tv_usec = (suseconds_t)(us % 1000000);
+}
+
+// Sender milliseconds at the start of the frame seq belongs to
+static uint32_t pipeline_timestamp(uint64_t seq) {
+    return (uint32_t)((seq - seq % PIPELINE_FRAME_PACKETS) * PIPELINE_INTERVAL_US / 1000);
+}
+
+static void pipeline_sizes(buffer_config_t *sizes) {
+    init_buffer_config(sizes);
+    sizes->bitrate_kbps = PIPELINE_BITRATE_KBPS;
+    buffer_config_size(sizes);
+}
+
+static void pipeline_release(pipeline_run_t *run, uint16_t seq) {
+    run->released++;
+    run->held_us += run->now_us - run->arrival_us[seq];
+}
+
+// The receive path before the playout buffer: a jitter FIFO holding every
+// packet JITTER_DELAY_MS, then a reorder buffer putting them in sequence
+static void drain_two_stage(pipeline_run_t *run, jitter_buffer_t *jb, reorder_buffer_t *rb,
+                            stats_t *stats) {
+    rtp_packet_t *packet;
+    size_t size;
+    while ((packet = jitter_buffer_get(jb, &size)) != NULL) {
+        uint64_t seq = run->ext_seqs[ntohs(packet->header.sequence)];
+        insert_packet(rb, seq, packet->payload, size - sizeof(rtp_header_t));
+    }
+    while (get_next_packet(rb, &size, stats) != NULL) {
+        pipeline_release(run, (uint16_t)(rb->expected_seq - 1));
+    }
+}
+
+static void drain_playout(pipeline_run_t *run, playout_buffer_t *pb, stats_t *stats) {
+    size_t size;
+    uint64_t seq;
+    while (playout_buffer_get(pb, &size, &seq, stats) != NULL) {
+        pipeline_release(run, (uint16_t)seq);
+    }
+}
+
+static void bench_pipeline(FILE *out, trace_t *trace, const char *trace_name, int two_stage) {
+    static pipeline_run_t run;
+    static jitter_buffer_t jb;
+    static reorder_buffer_t rb;
+    static playout_buffer_t pb;
+    static rtp_packet_t packet;
+    playout_clock_t clock;
+    bench_timer_t timer;
+    bench_timer_init(&timer);
+    stats_t stats;
+    init_stats(&stats);
+
+    init_playout_clock(&clock);
+    memset(&run, 0, sizeof(run));
+    pipeline_set_clock(&run, 0);
+    set_virtual_time(&run.clock);
+    for (size_t i = 0; i < trace->count; i++) {
+        run.ext_seqs[trace->seqs[i]] = trace->ext_seqs[i];
+    }
+
+    buffer_config_t sizes;
+    pipeline_sizes(&sizes);
+    if (two_stage) {
+        init_jitter_buffer(&jb, sizes.jitter_packets, NULL);
+        init_reorder_buffer(&rb, sizes.reorder_packets, NULL);
+    } else {
+        init_playout_buffer(&pb, sizes.playout_packets, 0, NULL);
+    }
+    size_t packet_size = sizeof(rtp_header_t) + BENCH_PAYLOAD_SIZE;
+
+    // Each arrival is timed with the polls that follow it, as in the
+    // client's loop; the final flush is not
+    for (size_t i = 0; i < trace->count; i++) {
+        pipeline_set_clock(&run, (uint64_t)i * PIPELINE_INTERVAL_US);
+        uint64_t seq = trace->ext_seqs[i];
+        make_packet(&packet, trace->seqs[i]);
+        packet.header.timestamp = htonl(pipeline_timestamp(seq));
+        run.arrival_us[trace->seqs[i]] = run.now_us;
+
+        bench_timer_start(&timer);
+        if (two_stage) {
+            jitter_buffer_add(&jb, &packet, packet_size);
+            drain_two_stage(&run, &jb, &rb, &stats);
+        } else {
+            // As the client does: gaps wait until the deadline of the
+            // frame the first missing packet belongs to
+            struct timeval gap_deadline;
+            playout_clock_update(&clock, pipeline_timestamp(seq), &run.clock);
+            playout_clock_deadline(&clock, pipeline_timestamp(pb.highest_seq + 1), &run.clock,
+                                   &gap_deadline);
+            playout_buffer_insert(&pb, seq, &packet, packet_size, &gap_deadline);
+            drain_playout(&run, &pb, &stats);
+        }
+        bench_timer_stop(&timer);
+    }
+    uint64_t end_us = run.now_us;
+    for (int ms = 1; ms <= PIPELINE_FLUSH_MS; ms++) {
+        pipeline_set_clock(&run, end_us + (uint64_t)ms * 1000);
+        if (two_stage) {
+            drain_two_stage(&run, &jb, &rb, &stats);
+        } else {
+            drain_playout(&run, &pb, &stats);
+        }
+    }
+    set_virtual_time(NULL);
+
+    if (two_stage) {
+        free_jitter_buffer(&jb);
+        free_reorder_buffer(&rb);
+    } else {
+        free_playout_buffer(&pb);
+    }
+
+    const char *op = two_stage ? "two_stage" : "playout";
+    bench_report(out, "pipeline", op, trace_name, trace->count, &timer);
+    bench_timer_close(&timer);
+    fprintf(stderr, "pipeline %-9s %-11s: %.2f ms held on average, %" PRIu64 " of %zu delivered, %" PRIu64 " given up\n",
+            op, trace_name, run.released ? run.held_us / 1000.0 / run.released : 0.0,
+            run.released, trace->count, stats.packets_lost);
+}
+
+static void bench_nack(FILE *out, trace_t *trace, const char *trace_name) {
+    static nack_buffer_t nb;
+    bench_timer_t request_timer, clear_timer, timeout_timer;
+    bench_timer_init(&request_timer);
+    bench_timer_init(&clear_timer);
+    bench_timer_init(&timeout_timer);
+    uint64_t requests = 0, clears = 0;
+
+    init_nack_buffer(&nb, NACK_BUFFER_SIZE);
+    uint64_t max_seq = trace->ext_seqs[0];
+
+    // Far enough out that no entry is abandoned during the run
+    struct timeval deadline;
+    get_monotonic_time(&deadline);
+    deadline.tv_sec += 3600;
+
+    for (size_t i = 0; i < trace->count; i++) {
+        uint64_t seq = trace->ext_seqs[i];
+
+        bench_timer_start(&clear_timer);
+        clear_nack_entry(&nb, seq);
+        bench_timer_stop(&clear_timer);
+        clears++;
+
+        int64_t diff = (int64_t)(seq - max_seq);
+        if (diff > 1 && diff < GAP_NACK_LIMIT) {
+            bench_timer_start(&request_timer);
+            for (int j = 1; j < diff; j++) {
+                uint64_t missing_seq = max_seq + j;
+                if (can_send_nack(&nb, missing_seq)) {
+                    record_nack_attempt(&nb, missing_seq, &deadline);
+                }
+            }
+            bench_timer_stop(&request_timer);
+            requests += diff - 1;
+        }
+        if (diff > 0) max_seq = seq;
+    }
+
+    // The client scans for timeouts once per loop iteration; no transport
+    // keeps any due retries from leaving the process
+    bench_timer_start(&timeout_timer);
+    for (int i = 0; i < NACK_TIMEOUT_CALLS; i++) {
+        manage_nack_timeouts(&nb, NULL, NULL);
+    }
+    bench_timer_stop(&timeout_timer);
+    free_nack_buffer(&nb);
+
+    if (requests > 0) {
+        bench_report(out, "nack", "request", trace_name, requests, &request_timer);
+    }
+    bench_report(out, "nack", "clear_nack_entry", trace_name, clears, &clear_timer);
+    bench_report(out, "nack", "manage_nack_timeouts", trace_name, NACK_TIMEOUT_CALLS, &timeout_timer);
+    bench_timer_close(&request_timer);
+    bench_timer_close(&clear_timer);
+    bench_timer_close(&timeout_timer);
+}
+
+// NACKs the gaps in the trace as the client does, with frame deadlines from
+// a playout clock, and runs the retry scan after every arrival. Packets the
+// trace lost never arrive, so each one NACKed should be asked for again
+// until NACK_MAX_RETRIES before its deadline. Returns 1 if any retry is missing.
+static int bench_nack_retries(FILE *out, trace_t *trace, const char *trace_name) {
+    static pipeline_run_t run;
+    static nack_buffer_t nb;
+    playout_clock_t clock;
+    bench_timer_t scan_timer;
+    bench_timer_init(&scan_timer);
+    stats_t stats;
+    init_stats(&stats);
+    uint64_t scans = 0, lost_nacked = 0;
+
+    buffer_config_t sizes;
+    pipeline_sizes(&sizes);
+    pipeline_set_clock(&run, 0);
+    set_virtual_time(&run.clock);
+    init_playout_clock(&clock);
+    init_nack_buffer(&nb, sizes.nack_entries);
+    uint64_t max_seq = trace->ext_seqs[0];
+
+    for (size_t i = 0; i < trace->count; i++) {
+        pipeline_set_clock(&run, (uint64_t)i * PIPELINE_INTERVAL_US);
+        uint64_t seq = trace->ext_seqs[i];
+        if (!clear_nack_entry(&nb, seq)) {
+            playout_clock_update(&clock, pipeline_timestamp(seq), &run.clock);
+        }
+
+        int64_t diff = (int64_t)(seq - max_seq);
+        if (diff > 1 && diff < GAP_NACK_LIMIT) {
+            for (uint64_t missing = max_seq + 1; missing < seq; missing++) {
+                struct timeval deadline;
+                playout_clock_deadline(&clock, pipeline_timestamp(missing), &run.clock, &deadline);
+                record_nack_attempt(&nb, missing, &deadline);
+                if (trace->lost[(uint16_t)missing]) lost_nacked++;
+            }
+        }
+        if (diff > 0) max_seq = seq;
+
+        bench_timer_start(&scan_timer);
+        manage_nack_timeouts(&nb, NULL, &stats);
+        bench_timer_stop(&scan_timer);
+        scans++;
+    }
+    uint64_t end_us = run.now_us;
+    for (int ms = 1; ms <= PLAYOUT_DELAY_MS + PLAYOUT_RECOVERY_MS + PIPELINE_FLUSH_MS; ms++) {
+        pipeline_set_clock(&run, end_us + (uint64_t)ms * 1000);
+        manage_nack_timeouts(&nb, NULL, &stats);
+    }
+    set_virtual_time(NULL);
+    free_nack_buffer(&nb);
+
+    bench_report(out, "nack", "retry_scan", trace_name, scans, &scan_timer);
+    bench_timer_close(&scan_timer);
+
+    uint64_t expected = lost_nacked * (NACK_MAX_RETRIES - 1);
+    fprintf(stderr, "nack retries %-11s: %" PRIu64 " for %" PRIu64 " lost packets NACKed (%" PRIu64 " expected), %" PRIu64 " abandoned\n",
+            trace_name, stats.nack_retries, lost_nacked, expected, stats.nacks_suppressed);
+    if (stats.nack_retries < expected) {
+        fprintf(stderr, "Error: NACKs for lost packets were not retried before their deadline\n");
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_path = (argc > 1) ? argv[1] : "bench_results.csv";
+    uint32_t seed = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 42;
+
+    FILE *out = fopen(output_path, "w");
+    if (!out) {
+        perror("Failed to open benchmark output");
+        return 1;
+    }
+
+    // The buffers log every packet; keep that off the terminal while still
+    // paying the formatting cost the real client pays
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("Failed to redirect stdout");
+    }
+
+    bench_report_header(out);
+    static trace_t trace;
+    int failures = 0;
+    for (int type = 0; type < TRACE_COUNT; type++) {
+        build_trace(&trace, (trace_type_t)type, seed + type);
+        for (size_t m = 0; m < sizeof(memory_configs) / sizeof(memory_configs[0]); m++) {
+            bench_jitter(out, &trace, trace_names[type], &memory_configs[m]);
+            bench_reorder(out, &trace, trace_names[type], &memory_configs[m]);
+        }
+        bench_nack(out, &trace, trace_names[type]);
+        failures += bench_nack_retries(out, &trace, trace_names[type]);
+        bench_pipeline(out, &trace, trace_names[type], 1);
+        bench_pipeline(out, &trace, trace_names[type], 0);
+    }
+
+    fclose(out);
+    fprintf(stderr, "Benchmark results written to %s\n", output_path);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtp.h"
+#include "jpeg_payload.h"
+#include "srtp.h"
+#include "bench_utils.h"
+
+#define BATCH_PACKETS 256
+#define TARGET_BYTES (64u * 1024 * 1024)  // per size and implementation
+
+// Payload sizes: a small fragment, Ethernet MTU, jumbo frame and the
+// largest datagram path probing can pick
+static const size_t payload_sizes[] = {200, 1400, 8900, 64000};
+
+static const uint8_t master_key[SRTP_MASTER_KEY_SIZE] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+};
+static const uint8_t master_salt[SRTP_MASTER_SALT_SIZE] = {
+    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab
+};
+
+// Test cases 1-4 of the GCM specification (McGrew and Viega), the AES-128
+// ones with a 96-bit IV, as hex
+typedef struct {
+    const char *key, *iv, *aad, *plaintext, *ciphertext, *tag;
+} gcm_vector_t;
+
+static const gcm_vector_t gcm_vectors[] = {
+    {"00000000000000000000000000000000", "000000000000000000000000", "", "", "",
+     "58e2fccefa7e3061367f1d57a4e7455a"},
+    {"00000000000000000000000000000000", "000000000000000000000000", "",
+     "00000000000000000000000000000000",
+     "0388dace60b6a392f328c2b971b2fe78",
+     "ab6e47d42cec13bdf53a67b21257bddf"},
+    {"feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888", "",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255",
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091473f5985",
+     "4d5c2af327cd64a62cf35abd2ba6fab4"},
+    {"feffe9928665731c6d6a8f9467308308", "cafebabefacedbaddecaf888",
+     "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+     "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+     "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+     "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+     "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+     "5bc94fbc3221a5db94fae95ae7121a47"},
+};
+
+// RFC 7714 section 16.1.1: AEAD_AES_128_GCM of one RTP packet, given the
+// session key and salt
+static const char *rfc7714_key = "000102030405060708090a0b0c0d0e0f";
+static const char *rfc7714_salt = "517569642070726f2071756f";
+static const char *rfc7714_packet =
+    "8040f17b8041f8d35501a0b2"
+    "47616c6c696120657374206f6d6e69732064697669736120696e207061727465732074726573";
+static const char *rfc7714_protected =
+    "8040f17b8041f8d35501a0b2"
+    "f24de3a3fb34de6cacba861c9d7e4bcabe633bd50d294e6f42a5f47a51c7d19b36de3adf8833"
+    "899d7f27beb16a9152cf765ee4390cce";
+#define RFC7714_SEQ 0xf17b  // the packet's sequence number, rollover counter 0
+
+static rtp_packet_t packets[BATCH_PACKETS];
+static int packet_sizes[BATCH_PACKETS];
+static uint8_t fragment[MAX_UDP_PAYLOAD];
+
+static int packetize(uint64_t seq, size_t payload, rtp_packet_t *packet) {
+    jpeg_payload_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.fragment_offset = (uint32_t)(seq * payload);
+    header.frame_length = 0x7FFFFFFF;
+    return create_jpeg_packet(packet, (uint16_t)seq, 1000, 0x12345678, &header, fragment, payload);
+}
+
+static size_t from_hex(const char *hex, uint8_t *out) {
+    size_t len = strlen(hex) / 2;
+    for (size_t i = 0; i < len; i++) {
+        char digits[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        out[i] = (uint8_t)strtoul(digits, NULL, 16);
+    }
+    return len;
+}
+
+static int check(const char *what, int vector, const uint8_t *got, const char *expected_hex) {
+    uint8_t expected[128];
+    size_t len = from_hex(expected_hex, expected);
+    if (memcmp(got, expected, len) != 0) {
+        fprintf(stderr, "Error: %s of vector %d does not match the known answer\n", what, vector);
+        return 1;
+    }
+    return 0;
+}
+
+// Known answers for one implementation: the GCM vectors through the AEAD
+// directly, then the RFC 7714 packet through srtp_protect and back.
+// Returns the number of mismatches.
+static int known_answers(int hardware) {
+    int failures = 0;
+    uint8_t key[AES_KEY_SIZE], iv[AES_GCM_IV_SIZE], aad[64], data[128], tag[AES_GCM_TAG_SIZE];
+
+    for (size_t v = 0; v < sizeof(gcm_vectors) / sizeof(gcm_vectors[0]); v++) {
+        const gcm_vector_t *t = &gcm_vectors[v];
+        aes_gcm_t gcm;
+        from_hex(t->key, key);
+        from_hex(t->iv, iv);
+        size_t aad_len = from_hex(t->aad, aad);
+        size_t len = from_hex(t->plaintext, data);
+        aes_gcm_init(&gcm, key, hardware);
+
+        aes_gcm_encrypt(&gcm, iv, aad, aad_len, data, len, tag);
+        failures += check("GCM ciphertext", (int)v + 1, data, t->ciphertext);
+        failures += check("GCM tag", (int)v + 1, tag, t->tag);
+        if (aes_gcm_decrypt(&gcm, iv, aad, aad_len, data, len, tag) < 0) {
+            fprintf(stderr, "Error: GCM vector %zu fails to authenticate\n", v + 1);
+            failures++;
+        }
+        failures += check("GCM decryption", (int)v + 1, data, t->plaintext);
+        tag[0] ^= 1;
+        if (aes_gcm_decrypt(&gcm, iv, aad, aad_len, data, len, tag) == 0) {
+            fprintf(stderr, "Error: GCM vector %zu authenticates with a corrupted tag\n", v + 1);
+            failures++;
+        }
+    }
+
+    srtp_t sender, receiver;
+    uint8_t salt[SRTP_MASTER_SALT_SIZE];
+    rtp_packet_t packet;
+    from_hex(rfc7714_key, key);
+    from_hex(rfc7714_salt, salt);
+    srtp_init_session(&sender, key, salt, hardware);
+    srtp_init_session(&receiver, key, salt, hardware);
+    int len = (int)from_hex(rfc7714_packet, (uint8_t*)&packet);
+    int protected_len = srtp_protect(&sender, &packet, len, RFC7714_SEQ);
+    if (protected_len != (int)strlen(rfc7714_protected) / 2) {
+        fprintf(stderr, "Error: RFC 7714 packet protected to %d bytes\n", protected_len);
+        failures++;
+    } else {
+        failures += check("SRTP protection", 7714, (uint8_t*)&packet, rfc7714_protected);
+    }
+    if (srtp_unprotect(&receiver, &packet, protected_len, RFC7714_SEQ) != len) {
+        fprintf(stderr, "Error: RFC 7714 packet fails to unprotect\n");
+        failures++;
+    } else {
+        failures += check("SRTP unprotection", 7714, (uint8_t*)&packet, rfc7714_packet);
+    }
+
+    fprintf(stderr, "%-14s known answers: %s\n", aes_gcm_implementation(&sender.gcm),
+            failures ? "FAILED" : "all match");
+    return failures;
+}
+
+static double mb_per_s(size_t payload, uint64_t ops, bench_timer_t *timer) {
+    return timer->elapsed_ns > 0 ? (double)payload * ops * 1000.0 / timer->elapsed_ns : 0.0;
+}
+
+// Plaintext packetizing is the baseline; protect is packetize plus
+// srtp_protect, unprotect is what the client adds per packet
+static void bench_size(FILE *out, int hardware, size_t payload) {
+    static srtp_t sender, receiver;
+    srtp_init(&sender, master_key, master_salt, hardware);
+    srtp_init(&receiver, master_key, master_salt, hardware);
+
+    bench_timer_t plain_timer, protect_timer, unprotect_timer;
+    bench_timer_init(&plain_timer);
+    bench_timer_init(&protect_timer);
+    bench_timer_init(&unprotect_timer);
+
+    uint64_t rounds = TARGET_BYTES / (payload * BATCH_PACKETS) + 1;
+    uint64_t ops = 0;
+    uint64_t seq = 0;
+    int failures = 0;
+
+    for (uint64_t r = 0; r < rounds; r++) {
+        bench_timer_start(&plain_timer);
+        for (int i = 0; i < BATCH_PACKETS; i++) {
+            packet_sizes[i] = packetize(seq + i, payload, &packets[i]);
+        }
+        bench_timer_stop(&plain_timer);
+
+        bench_timer_start(&protect_timer);
+        for (int i = 0; i < BATCH_PACKETS; i++) {
+            int size = packetize(seq + i, payload, &packets[i]);
+            packet_sizes[i] = srtp_protect(&sender, &packets[i], size, seq + i);
+        }
+        bench_timer_stop(&protect_timer);
+
+        bench_timer_start(&unprotect_timer);
+        for (int i = 0; i < BATCH_PACKETS; i++) {
+            if (srtp_unprotect(&receiver, &packets[i], packet_sizes[i], seq + i) < 0) {
+                failures++;
+            }
+        }
+        bench_timer_stop(&unprotect_timer);
+
+        seq += BATCH_PACKETS;
+        ops += BATCH_PACKETS;
+    }
+
+    char trace[64];
+    snprintf(trace, sizeof(trace), "%s_%zuB", aes_gcm_implementation(&sender.gcm), payload);
+    bench_report(out, "srtp", "packetize_plain", trace, ops, &plain_timer);
+    bench_report(out, "srtp", "packetize_protect", trace, ops, &protect_timer);
+    bench_report(out, "srtp", "unprotect", trace, ops, &unprotect_timer);
+
+    fprintf(stderr, "%-14s plain %8.1f MB/s  protect %8.1f MB/s  unprotect %8.1f MB/s%s\n",
+            trace, mb_per_s(payload, ops, &plain_timer), mb_per_s(payload, ops, &protect_timer),
+            mb_per_s(payload, ops, &unprotect_timer), failures ? "  (AUTH FAILURES)" : "");
+
+    bench_timer_close(&plain_timer);
+    bench_timer_close(&protect_timer);
+    bench_timer_close(&unprotect_timer);
+}
+
+int main(int argc, char *argv[]) {
+    const char *output_path = (argc > 1) ? argv[1] : "bench_srtp_results.csv";
+
+    FILE *out = fopen(output_path, "w");
+    if (!out) {
+        perror("Failed to open benchmark output");
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(fragment); i++) {
+        fragment[i] = (uint8_t)(i * 31);
+    }
+
+    bench_report_header(out);
+    int failures = 0;
+    for (int hardware = 1; hardware >= 0; hardware--) {
+        if (hardware && !aes_gcm_hardware_available()) {
+            fprintf(stderr, "No AES-NI/PCLMULQDQ on this CPU, measuring the table path only\n");
+            continue;
+        }
+        failures += known_answers(hardware);
+        for (size_t i = 0; i < sizeof(payload_sizes) / sizeof(payload_sizes[0]); i++) {
+            bench_size(out, hardware, payload_sizes[i]);
+        }
+    }
+
+    fclose(out);
+    fprintf(stderr, "Benchmark results written to %s\n", output_path);
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include "bench_utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = type;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    return fd;
+}
+
+static uint64_t read_counter(int fd) {
+    uint64_t value = 0;
+    if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+        return 0;
+    }
+    return value;
+}
+
+// Cost of an empty start/stop pair, subtracted from every measurement so
+// per-call timing of cheap operations is not dominated by the clock read
+static uint64_t clock_overhead_ns(void) {
+    static uint64_t overhead = UINT64_MAX;
+    if (overhead != UINT64_MAX) {
+        return overhead;
+    }
+
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t start = bench_now_ns();
+        uint64_t end = bench_now_ns();
+        if (end - start < best) best = end - start;
+    }
+    overhead = best;
+    return overhead;
+}
+
+void bench_timer_init(bench_timer_t *timer) {
+    memset(timer, 0, sizeof(bench_timer_t));
+    timer->perf_fd = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    timer->tlb_fd = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    clock_overhead_ns();
+}
+
+void bench_timer_start(bench_timer_t *timer) {
+    // Counter is read outside the timed region so the syscall is not measured
+    timer->start_misses = read_counter(timer->perf_fd);
+    timer->start_tlb_misses = read_counter(timer->tlb_fd);
+    timer->start_ns = bench_now_ns();
+}
+
+void bench_timer_stop(bench_timer_t *timer) {
+    uint64_t end_ns = bench_now_ns();
+    uint64_t end_misses = read_counter(timer->perf_fd);
+    uint64_t end_tlb_misses = read_counter(timer->tlb_fd);
+
+    uint64_t elapsed = end_ns - timer->start_ns;
+    uint64_t overhead = clock_overhead_ns();
+
+    timer->elapsed_ns += (elapsed > overhead) ? elapsed - overhead : 0;
+    timer->cache_misses += end_misses - timer->start_misses;
+    timer->tlb_misses += end_tlb_misses - timer->start_tlb_misses;
+}
+
+void bench_timer_close(bench_timer_t *timer) {
+    if (timer->perf_fd >= 0) {
+        close(timer->perf_fd);
+        timer->perf_fd = -1;
+    }
+    if (timer->tlb_fd >= 0) {
+        close(timer->tlb_fd);
+        timer->tlb_fd = -1;
+    }
+}
+
+void bench_report_header(FILE *out) {
+    fprintf(out, "suite,op,trace,ops,total_ns,ns_per_op,cache_misses_per_op,dtlb_misses_per_op\n");
+}
+
+void bench_report(FILE *out, const char *suite, const char *op, const char *trace,
+                  uint64_t ops, bench_timer_t *timer) {
+    double ns_per_op = ops > 0 ? (double)timer->elapsed_ns / (double)ops : 0.0;
+
+    fprintf(out, "%s,%s,%s,%llu,%llu,%.2f,", suite, op, trace,
+            (unsigned long long)ops, (unsigned long long)timer->elapsed_ns, ns_per_op);
+    if (timer->perf_fd >= 0 && ops > 0) {
+        fprintf(out, "%.4f,", (double)timer->cache_misses / (double)ops);
+    } else {
+        fprintf(out, "NA,");
+    }
+    if (timer->tlb_fd >= 0 && ops > 0) {
+        fprintf(out, "%.4f\n", (double)timer->tlb_misses / (double)ops);
+    } else {
+        fprintf(out, "NA\n");
+    }
+    fflush(out);
+}
@@ -0,0 +1,33 @@
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Accumulating timer for a benchmark phase. Only the code between
+// bench_timer_start() and bench_timer_stop() is measured, so setup work
+// (building traces, ageing packets) can sit between phases.
+typedef struct {
+    int perf_fd;            // cache-miss counter, -1 when perf events are unavailable
+    int tlb_fd;             // data TLB load-miss counter, likewise
+    uint64_t elapsed_ns;
+    uint64_t cache_misses;
+    uint64_t tlb_misses;
+    uint64_t start_ns;
+    uint64_t start_misses;
+    uint64_t start_tlb_misses;
+} bench_timer_t;
+
+uint64_t bench_now_ns(void);
+
+void bench_timer_init(bench_timer_t *timer);
+void bench_timer_start(bench_timer_t *timer);
+void bench_timer_stop(bench_timer_t *timer);
+void bench_timer_close(bench_timer_t *timer);
+
+// Results are written as CSV, one row per (suite, operation, trace)
+void bench_report_header(FILE *out);
+void bench_report(FILE *out, const char *suite, const char *op, const char *trace,
+                  uint64_t ops, bench_timer_t *timer);
+
+#endif // BENCH_UTILS_H
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "buffer_config.h"
+#include "rtp.h"
+#include "jitter_buffer.h"
+#include "reorder_buffer.h"
+#include "playout_buffer.h"
+#include "playout_clock.h"
+#include "nack_buffer.h"
+#include "time_utils.h"
+
+#define SERVER_RETRANSMIT_WINDOW_MS 100     // how long past sending a NACK can still be served
+
+void init_buffer_config(buffer_config_t *cfg) {
+    memset(cfg, 0, sizeof(buffer_config_t));
+    cfg->bitrate_kbps = DEFAULT_BITRATE_KBPS;
+    cfg->rtt_ms = RTT_MS;
+    cfg->max_frame_size = DEFAULT_MAX_FRAME_SIZE;
+    cfg->hugepages = ARENA_PAGES_TRANSPARENT;
+    buffer_config_size(cfg);
+}
+
+static int parse_value(const char *name, const char *text, unsigned long long max,
+                       unsigned long long *value) {
+    char *end;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (*text == '\0' || *end != '\0' || parsed == 0 || parsed > max) {
+        fprintf(stderr, "Invalid value for %s: %s\n", name, text);
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+int buffer_config_parse(buffer_config_t *cfg, int argc, char *argv[]) {
+    int out = 1;
+    for (int i = 1; i < argc; i++) {
+        const char *name = argv[i];
+        if (strcmp(name, "--lock-memory") == 0) {
+            cfg->lock_memory = 1;
+            continue;
+        }
+        int is_option = strcmp(name, "--bitrate-kbps") == 0 || strcmp(name, "--rtt-ms") == 0 ||
+                        strcmp(name, "--max-frame-bytes") == 0 || strcmp(name, "--hugepages") == 0;
+        if (!is_option) {
+            argv[out++] = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", name);
+            return -1;
+        }
+
+        unsigned long long value;
+        const char *text = argv[++i];
+        if (strcmp(name, "--bitrate-kbps") == 0) {
+            if (parse_value(name, text, 100000000ULL, &value) < 0) return -1;
+            cfg->bitrate_kbps = (uint32_t)value;
+        } else if (strcmp(name, "--rtt-ms") == 0) {
+            if (parse_value(name, text, 60000ULL, &value) < 0) return -1;
+            cfg->rtt_ms = (uint32_t)value;
+        } else if (strcmp(name, "--hugepages") == 0) {
+            if (arena_parse_pages(text, &cfg->hugepages) < 0) {
+                fprintf(stderr, "Invalid value for %s: %s (off, transparent or explicit)\n", name, text);
+                return -1;
+            }
+        } else {
+            if (parse_value(name, text, BUFFER_MAX_FRAME_SIZE, &value) < 0) return -1;
+            cfg->max_frame_size = (size_t)value;
+        }
+    }
+    argv[out] = NULL;
+    buffer_config_size(cfg);
+    return out;
+}
+
+// Packets arriving in ms at the configured bitrate
+static size_t packets_in(const buffer_config_t *cfg, uint32_t ms) {
+    uint64_t bytes = (uint64_t)cfg->bitrate_kbps * ms / 8;
+    return (size_t)((bytes + BUFFER_SIZING_DATAGRAM - 1) / BUFFER_SIZING_DATAGRAM);
+}
+
+static int clamp_packets(size_t packets, int minimum) {
+    if (packets < (size_t)minimum) return minimum;
+    if (packets > BUFFER_MAX_PACKETS) return BUFFER_MAX_PACKETS;
+    return (int)packets;
+}
+
+// Twice the bandwidth-delay product of the time each buffer holds a packet:
+// the playout buffer its delay plus a NACK round trip and the gap wait (the
+// jitter buffer only the delay, the reorder buffer the rest), the NACK
+// buffer every retry until playout, and the server every packet a NACK
+// could still ask for, at least two whole frames
+void buffer_config_size(buffer_config_t *cfg) {
+    size_t frame_packets = (cfg->max_frame_size + BUFFER_SIZING_DATAGRAM - 1) / BUFFER_SIZING_DATAGRAM;
+    size_t stored = packets_in(cfg, 2 * cfg->rtt_ms + SERVER_RETRANSMIT_WINDOW_MS);
+    if (stored < 2 * frame_packets) stored = 2 * frame_packets;
+
+    cfg->playout_packets = clamp_packets(2 * packets_in(cfg, cfg->rtt_ms + PLAYOUT_DELAY_MS +
+                                                            PLAYOUT_RECOVERY_MS),
+                                         PLAYOUT_BUFFER_SIZE);
+    cfg->jitter_packets = clamp_packets(2 * packets_in(cfg, JITTER_DELAY_MS), JITTER_BUFFER_SIZE);
+    cfg->reorder_packets = clamp_packets(2 * packets_in(cfg, cfg->rtt_ms + NEXT_PACKET_WAIT_MS),
+                                         REORDER_BUFFER_SIZE);
+    cfg->nack_entries = clamp_packets(2 * packets_in(cfg, PLAYOUT_DELAY_MS + PLAYOUT_RECOVERY_MS),
+                                      NACK_BUFFER_SIZE);
+    cfg->frame_bytes = cfg->max_frame_size;
+    cfg->stored_packets = clamp_packets(stored, MIN_STORED_PACKETS);
+}
+
+void print_buffer_config(const buffer_config_t *cfg) {
+    printf("Buffers sized for %u kbps, %u ms RTT, %zu-byte frames: "
+           "playout %d, NACK %d packets, frame %zu bytes\n",
+           cfg->bitrate_kbps, cfg->rtt_ms, cfg->max_frame_size,
+           cfg->playout_packets, cfg->nack_entries, cfg->frame_bytes);
+}
+
+size_t buffer_grow_capacity(size_t current, size_t needed, size_t limit) {
+    size_t grown = current * 2;
+    while (grown < needed) grown *= 2;
+    if (grown > limit) grown = limit;
+    return grown > current ? grown : current;
+}
+
+int buffer_overflow_sustained(buffer_overflow_t *overflow) {
+    struct timeval now;
+    get_monotonic_time(&now);
+    if (overflow->count == 0 || time_diff_ms(&overflow->window_start, &now) > BUFFER_GROW_WINDOW_MS) {
+        overflow->count = 0;
+        overflow->window_start = now;
+    }
+    if (++overflow->count < BUFFER_GROW_OVERFLOWS) {
+        return 0;
+    }
+    overflow->count = 0;
+    return 1;
+}
@@ -0,0 +1,67 @@
+#ifndef BUFFER_CONFIG_H
+#define BUFFER_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "arena.h"
+
+#define DEFAULT_BITRATE_KBPS 20000
+#define DEFAULT_MAX_FRAME_SIZE 1000000      // frame buffers grow past this on demand
+#define BUFFER_SIZING_DATAGRAM 1400         // packet counts assume the smallest usual datagram
+#define BUFFER_MAX_PACKETS 32768            // beyond this sequence numbers stop extending reliably
+#define BUFFER_MAX_FRAME_SIZE 268435456     // frame buffers never grow past 256 MB
+#define MIN_STORED_PACKETS 1000
+#define BUFFER_GROW_OVERFLOWS 16            // overflows within BUFFER_GROW_WINDOW_MS before a buffer grows
+#define BUFFER_GROW_WINDOW_MS 1000
+
+// Buffer capacities derived at startup from the expected bitrate, RTT and
+// largest frame, so one binary suits both a slow uplink and a fast LAN.
+// Every buffer still grows at runtime when it keeps overflowing.
+typedef struct {
+    uint32_t bitrate_kbps;
+    uint32_t rtt_ms;
+    size_t max_frame_size;
+
+    // Derived by buffer_config_size
+    int playout_packets;
+    int jitter_packets;     // the two-stage jitter/reorder path, kept for benchmarks
+    int reorder_packets;
+    int nack_entries;
+    size_t frame_bytes;
+    int stored_packets;     // server retransmission storage
+
+    // Backing of the arena the packet and frame buffers are carved from
+    arena_pages_t hugepages;
+    int lock_memory;
+} buffer_config_t;
+
+// Defaults, already sized
+void init_buffer_config(buffer_config_t *cfg);
+
+// Takes --bitrate-kbps, --rtt-ms, --max-frame-bytes and --hugepages (each
+// followed by a value) and --lock-memory out of argv, shifting the remaining
+// arguments down, and re-derives the capacities. Returns the new argc, or
+// -1 on a malformed value.
+int buffer_config_parse(buffer_config_t *cfg, int argc, char *argv[]);
+
+void buffer_config_size(buffer_config_t *cfg);
+
+void print_buffer_config(const buffer_config_t *cfg);
+
+// Overflows of one buffer. A burst that overflows it once is dropped as
+// before; growing is kept for a buffer that overflows again and again.
+typedef struct {
+    int count;
+    struct timeval window_start;
+} buffer_overflow_t;
+
+// Records an overflow. Returns 1 when it is the BUFFER_GROW_OVERFLOWS-th
+// within BUFFER_GROW_WINDOW_MS, and starts counting afresh.
+int buffer_overflow_sustained(buffer_overflow_t *overflow);
+
+// Doubled capacity for a buffer that overflowed, capped at limit; returns
+// current unchanged when it is already at the limit
+size_t buffer_grow_capacity(size_t current, size_t needed, size_t limit);
+
+#endif // BUFFER_CONFIG_H
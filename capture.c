@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+#define CAPTURE_HEADER_SIZE 16
+#define CAPTURE_RECORD_HEADER_SIZE 6
+#define CAPTURE_WRITE_BUFFER (1 << 20)
+
+static void put_le(uint8_t *out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const uint8_t *in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t)in[i] << (8 * i);
+    }
+    return value;
+}
+
+static uint64_t timeval_to_us(struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000000ULL + (uint64_t)tv->tv_usec;
+}
+
+int capture_open_write(capture_t *cap, const char *path) {
+    memset(cap, 0, sizeof(capture_t));
+    cap->fp = fopen(path, "wb");
+    if (!cap->fp) {
+        perror("Failed to open capture file");
+        return -1;
+    }
+    // Recording sits on the receive path, so keep writes off the syscall path
+    setvbuf(cap->fp, NULL, _IOFBF, CAPTURE_WRITE_BUFFER);
+    cap->writing = 1;
+    return 0;
+}
+
+int capture_open_read(capture_t *cap, const char *path) {
+    memset(cap, 0, sizeof(capture_t));
+    cap->fp = fopen(path, "rb");
+    if (!cap->fp) {
+        perror("Failed to open capture file");
+        return -1;
+    }
+
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), cap->fp) != sizeof(header) ||
+        memcmp(header, CAPTURE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: %s is not a capture file\n", path);
+        capture_close(cap);
+        return -1;
+    }
+    unsigned version = (unsigned)get_le(header + 4, 2);
+    if (version != CAPTURE_VERSION) {
+        fprintf(stderr, "Error: %s is a version %u capture, this build replays version %d; "
+                "record it again\n", path, version, CAPTURE_VERSION);
+        capture_close(cap);
+        return -1;
+    }
+    cap->first_us = get_le(header + 8, 8);
+    cap->last_us = cap->first_us;
+    cap->have_first = 1;
+    return 0;
+}
+
+int capture_write(capture_t *cap, struct timeval *arrival, const uint8_t *data, size_t len) {
+    uint64_t arrival_us = timeval_to_us(arrival);
+
+    if (!cap->have_first) {
+        uint8_t header[CAPTURE_HEADER_SIZE];
+        memset(header, 0, sizeof(header));
+        memcpy(header, CAPTURE_MAGIC, 4);
+        put_le(header + 4, CAPTURE_VERSION, 2);
+        put_le(header + 8, arrival_us, 8);
+        if (fwrite(header, 1, sizeof(header), cap->fp) != sizeof(header)) {
+            return -1;
+        }
+        cap->first_us = arrival_us;
+        cap->last_us = arrival_us;
+        cap->have_first = 1;
+    }
+
+    if (len > 0xFFFF) {
+        return -1;
+    }
+
+    uint64_t delta = arrival_us - cap->last_us;
+    if (delta > 0xFFFFFFFFULL) {
+        delta = 0xFFFFFFFFULL; // idle gaps over ~71 minutes are clamped
+    }
+    cap->last_us += delta;
+
+    uint8_t record[CAPTURE_RECORD_HEADER_SIZE];
+    put_le(record, delta, 4);
+    put_le(record + 4, len, 2);
+    if (fwrite(record, 1, sizeof(record), cap->fp) != sizeof(record) ||
+        fwrite(data, 1, len, cap->fp) != len) {
+        return -1;
+    }
+    return 0;
+}
+
+int capture_read(capture_t *cap, struct timeval *arrival, uint8_t *data,
+                 size_t max_len, size_t *len) {
+    uint8_t record[CAPTURE_RECORD_HEADER_SIZE];
+    size_t got = fread(record, 1, sizeof(record), cap->fp);
+    if (got == 0) {
+        return 0;
+    }
+    if (got != sizeof(record)) {
+        return -1;
+    }
+
+    *len = (size_t)get_le(record + 4, 2);
+    if (*len > max_len || fread(data, 1, *len, cap->fp) != *len) {
+        return -1;
+    }
+
+    cap->last_us += get_le(record, 4);
+    arrival->tv_sec = (long)(cap->last_us / 1000000ULL);
+    arrival->tv_usec = (long)(cap->last_us % 1000000ULL);
+    return 1;
+}
+
+void capture_close(capture_t *cap) {
+    if (cap->fp) {
+        fclose(cap->fp);
+        cap->fp = NULL;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+// Capture file layout (all fields little-endian):
+//   header: "RCAP" | u16 version | u16 reserved | u64 first arrival (us, monotonic)
+//   record: u32 arrival delta from previous record (us) | u16 length | datagram
+#define CAPTURE_MAGIC "RCAP"
+// Version 2: the RTP header's first two bytes as RFC 3550 lays them out;
+// version 1 files hold them in the earlier order and do not replay
+#define CAPTURE_VERSION 2
+
+typedef struct {
+    FILE *fp;
+    int writing;
+    int have_first;
+    uint64_t first_us;
+    uint64_t last_us;
+} capture_t;
+
+int capture_open_write(capture_t *cap, const char *path);
+int capture_open_read(capture_t *cap, const char *path);
+
+int capture_write(capture_t *cap, struct timeval *arrival, const uint8_t *data, size_t len);
+
+// Returns 1 when a record was read, 0 at end of file, -1 on a malformed file
+int capture_read(capture_t *cap, struct timeval *arrival, uint8_t *data,
+                 size_t max_len, size_t *len);
+
+void capture_close(capture_t *cap);
+
+#endif // CAPTURE_H
@@ -1,247 +1,159 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
 #include <sys/time.h>
 #include <errno.h>
-#include <sys/stat.h> 
+#include <sys/stat.h>
+#include <signal.h>
 #include "rtp.h"
 #include "stats.h"
-#include "reorder_buffer.h"
-#include "jitter_buffer.h"
-#include "nack_buffer.h" 
-#include "time_utils.h"  
+#include "receiver.h"
+#include "capture.h"
+#include "time_utils.h"
+#include "transport.h"
+#include "trace.h"
+#include "buffer_config.h"
 
-#define BUFFER_SIZE 10000000 
-#define TIMEOUT_SEC 5
-#define CHUNK_SIZE 1400
 
+static volatile sig_atomic_t running = 1;
 
-int is_valid_jpeg(uint8_t *buf, size_t size) {
-    if (size < 4) return 0;
-
-    if (buf[0] != 0xFF || buf[1] != 0xD8) return 0;
-    if (buf[size-2] != 0xFF || buf[size-1] != 0xD9) return 0;
-
-    return 1;
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
 }
 
-void save_frame(uint8_t *buffer, size_t size, int frame_num) {
-    if (!is_valid_jpeg(buffer, size)) {
-        return;
-    }
-    char filename[64];
-    snprintf(filename, sizeof(filename), "frames/received_frame_%04d.jpg", frame_num);
-    FILE *fp = fopen(filename, "wb");
-    if (fp) {
-        fwrite(buffer, 1, size, fp);
-        fclose(fp);
-        printf("Saved frame %d to %s\n", frame_num, filename);
-    } else {
-        perror("Failed to save frame");
+int main(int argc, char *argv[]) {
+    buffer_config_t buffer_config;
+    init_buffer_config(&buffer_config);
+    argc = buffer_config_parse(&buffer_config, argc, argv);
+
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "Usage: %s <port | shm:name> [capture_file] [--bitrate-kbps N] [--rtt-ms N] [--max-frame-bytes N] [--hugepages off|transparent|explicit] [--lock-memory]\n", argv[0]);
+        return 1;
     }
-}
 
+    const char *listen_spec = argv[1];
+    const char *capture_file = (argc == 3) ? argv[2] : NULL;
 
-void process_packet(uint8_t *frame_buffer, size_t *frame_offset, 
-                    uint16_t seq, uint8_t *payload, size_t payload_size,
-                    uint16_t frame_start_seq) {
-    size_t position = (seq - frame_start_seq) * CHUNK_SIZE; 
-    
-    if (position + payload_size < BUFFER_SIZE) {
-        memcpy(frame_buffer + position, payload, payload_size);
-        if (position + payload_size > *frame_offset) {
-            *frame_offset = position + payload_size;
-        }
+    transport_t transport;
+    if (transport_open_receiver(&transport, listen_spec) < 0) {
+        return 1;
     }
-}
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+    // No SA_RESTART so a blocked receive returns and the loop can exit
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (trace_open("client") < 0) {
+        transport_close(&transport);
         return 1;
     }
-    
-    int port = atoi(argv[1]);
-    
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        perror("Socket creation failed");
+
+    capture_t capture;
+    if (capture_file && capture_open_write(&capture, capture_file) < 0) {
+        transport_close(&transport);
         return 1;
     }
-    
-    struct timeval timeout;
-    timeout.tv_sec = TIMEOUT_SEC;
-    timeout.tv_usec = 0;
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    
-    struct sockaddr_in client_addr;
-    memset(&client_addr, 0, sizeof(client_addr));
-    client_addr.sin_family = AF_INET;
-    client_addr.sin_port = htons(port);
-    client_addr.sin_addr.s_addr = INADDR_ANY;
-    
-    if (bind(sockfd, (struct sockaddr*)&client_addr, sizeof(client_addr)) < 0) {
-        perror("Bind failed");
-        close(sockfd);
-        return 1;
+
+    if (transport_is_local(&transport)) {
+        printf("RTP Client waiting on shared-memory ring %s...\n", listen_spec);
+    } else {
+        printf("RTP Client listening on port %s...\n", listen_spec);
+    }
+    if (capture_file) {
+        printf("Recording received datagrams to %s\n", capture_file);
     }
-    
-    printf("RTP Client listening on port %d...\n", port);
     printf("Press Ctrl+C to stop and save the last frame\n\n");
-    
-    reorder_buffer_t reorder_buf;
-    jitter_buffer_t jitter_buf;
-    nack_buffer_t nack_buf; 
-    
-    init_reorder_buffer(&reorder_buf);
-    init_jitter_buffer(&jitter_buf);
-    init_nack_buffer(&nack_buf); 
-    
-    uint8_t *frame_buffer = (uint8_t*)malloc(BUFFER_SIZE);
-    uint8_t *last_complete_frame = (uint8_t*)malloc(BUFFER_SIZE);
-    if (!frame_buffer || !last_complete_frame) {
-        perror("Buffer allocation failed");
-        close(sockfd);
+
+    // Playout slots are carved at the datagram size the server settles on,
+    // so its opening probe round is answered before the buffers are set up:
+    // the largest probe that got through is the size it will send. Should
+    // the round have been missed, the first RTP datagram stands in.
+    static rtp_packet_t packet;
+    ssize_t recv_len = 0;
+    size_t datagram_size = 0;
+    while (running) {
+        recv_len = transport_recv(&transport, &packet, sizeof(packet), RECEIVER_POLL_MS);
+        if (recv_len <= 0) {
+            continue;
+        }
+        if (recv_len < (ssize_t)sizeof(probe_packet_t) || ((uint8_t*)&packet)[0] != PACKET_TYPE_PROBE) {
+            break;
+        }
+        send_probe_ack(&transport, (probe_packet_t*)&packet, recv_len);
+        if ((size_t)recv_len > datagram_size) datagram_size = recv_len;
+    }
+    if (!running) {
+        if (capture_file) capture_close(&capture);
+        trace_close();
+        transport_close(&transport);
+        return 0;
+    }
+    if (datagram_size == 0) datagram_size = recv_len;
+
+    // Holds the frame assembler's fragment table, too large for the stack
+    static receiver_t rx;
+    print_buffer_config(&buffer_config);
+    printf("Playout slots sized for %zu-byte datagrams\n", datagram_size);
+    if (init_receiver(&rx, &transport, &buffer_config, datagram_size) < 0) {
+        transport_close(&transport);
         return 1;
     }
-    
-    stats_t stats;
-    init_stats(&stats);
-    
-    size_t frame_offset = 0;
-    size_t last_frame_size = 0;
-    uint32_t current_timestamp = 0;
-    int frame_count = 0;
-    uint16_t frame_start_seq = 0;
-    uint16_t frame_end_seq = 0; 
-    uint16_t max_seq_received = 0;
-    int first_packet = 1;
-
-    struct sockaddr_in server_addr;
-    socklen_t server_addr_len = sizeof(server_addr);
-
-    while (1) {
-        rtp_packet_t packet;
-        ssize_t recv_len = recvfrom(sockfd, &packet, sizeof(packet), 0,
-                                    (struct sockaddr*)&server_addr, &server_addr_len);
-        
-        struct timeval now;
-        get_monotonic_time(&now); 
-        
-        if (recv_len > 0) {
-            stats.packets_received++;
-            stats.total_bytes += recv_len;
-            
-            uint16_t seq = ntohs(packet.header.sequence);
-
-            clear_nack_entry(&nack_buf, seq);
-
-            if (first_packet) {
-                max_seq_received = seq;
-                first_packet = 0;
-            } else {
-                int16_t diff = seq - max_seq_received;
-            
-                if (diff > 1 && diff < 100) { 
-                    printf("Gap detected! Last: %u, Current: %u. Checking %d packets for NACK.\n", 
-                            max_seq_received, seq, diff - 1);
-                
-                    for (int i = 1; i < diff; i++) {
-                        uint16_t missing_seq = max_seq_received + i;
-                        
-                        send_nack(sockfd, &server_addr, missing_seq);
-                        record_nack_attempt(&nack_buf, missing_seq);
-                        stats.retransmit_requests++;
-                    }
-                }
-                if (diff > 0) max_seq_received = seq;
-            }
 
-            jitter_buffer_add(&jitter_buf, &packet, recv_len);
+    static srtp_t srtp;
+    int keyed = srtp_init_from_env(&srtp);
+    if (keyed < 0) {
+        free_receiver(&rx);
+        transport_close(&transport);
+        return 1;
+    }
+    rx.srtp = keyed ? &srtp : NULL;
+
+    uint64_t stats_printed_at = 0;
+    while (running) {
+        // Wake up regularly so buffered packets are released on time even
+        // when nothing else arrives (repeat and delta frames are a packet or
+        // two); the first datagram after the probes is already waiting
+        if (recv_len <= 0) {
+            recv_len = transport_recv(&transport, &packet, sizeof(packet), RECEIVER_POLL_MS);
         }
 
-
-        manage_nack_timeouts(&nack_buf, sockfd, &server_addr);
-        size_t jitter_packet_size;
-        rtp_packet_t *ready_packet = jitter_buffer_get(&jitter_buf, &jitter_packet_size);
-
-        if (ready_packet != NULL) {
-            uint16_t seq = ntohs(ready_packet->header.sequence);
-            uint32_t timestamp = ntohl(ready_packet->header.timestamp);
-            size_t payload_size = jitter_packet_size - sizeof(rtp_header_t);
-            
-            if (current_timestamp != 0 && timestamp != current_timestamp) {
-                printf("--- Frame boundary detected (TS change). Resetting state for Frame %d ---\n", frame_count);
-                
-                current_timestamp = 0; 
-                frame_offset = 0;
-                frame_end_seq = 0; 
-                memset(frame_buffer, 0, BUFFER_SIZE);
-                init_reorder_buffer(&reorder_buf);
-                init_nack_buffer(&nack_buf);
-            }
-            
-            if (current_timestamp == 0) {
-                current_timestamp = timestamp;
-                frame_start_seq = seq;
-            }
-
-            if (ready_packet->header.marker) {
-                frame_end_seq = seq;
-                printf("Received last packet (marker bit set)\n");
-            }
-            
-            int in_order = insert_packet(&reorder_buf, seq, 
-                                         ready_packet->payload, payload_size);
-            if (!in_order) stats.packets_reordered++;
-            
-            size_t buffered_size;
-            uint8_t *buffered_data = get_next_packet(&reorder_buf, &buffered_size, &stats);
-            
-            while (buffered_data != NULL) {
-                uint16_t buffered_seq = reorder_buf.expected_seq - 1;
-                
-                process_packet(frame_buffer, &frame_offset, buffered_seq,
-                              buffered_data, buffered_size, frame_start_seq);
-                
-                if (buffered_seq == frame_end_seq && frame_end_seq != 0) {
-                    printf("Frame %d complete (Marker Bit): %zu bytes\n", frame_count, frame_offset);
-                    save_frame(frame_buffer, frame_offset, frame_count);
-                    
-                    stats.frames_received++;
-                    frame_count++;
-
-                    frame_offset = 0;
-                    memset(frame_buffer, 0, BUFFER_SIZE);
-                    current_timestamp = 0; 
-                    frame_start_seq = 0;
-                    frame_end_seq = 0; 
-                    init_reorder_buffer(&reorder_buf);
-                    init_nack_buffer(&nack_buf);
-                    break; 
-                }
-                
-                buffered_data = get_next_packet(&reorder_buf, &buffered_size, &stats);
+        // Take in whatever else is already queued before running the
+        // pipeline, so a backlog shows up in the buffers where whole stale
+        // frames can be dropped, rather than waiting unseen in the socket
+        for (int batch = 1; recv_len > 0; batch++) {
+            struct timeval now;
+            get_monotonic_time(&now);
+            if (capture_file && capture_write(&capture, &now, (uint8_t*)&packet, recv_len) < 0) {
+                fprintf(stderr, "Warning: failed to record packet, capture stopped\n");
+                capture_close(&capture);
+                capture_file = NULL;
             }
+            receiver_handle_packet(&rx, &packet, recv_len);
+            recv_len = (batch < RECEIVER_MAX_BATCH) ?
+                       transport_recv(&transport, &packet, sizeof(packet), 0) : 0;
         }
-        
-        if (stats.packets_received % 100 == 0 && stats.packets_received > 0) {
-            print_stats(&stats);
+
+        receiver_process(&rx);
+
+        if (rx.stats.packets_received >= stats_printed_at + 100) {
+            print_stats(&rx.stats);
+            stats_printed_at = rx.stats.packets_received;
         }
     }
-    
-    if (last_frame_size > 0) {
-        printf("\nSaving last received frame...\n");
-        save_frame(last_complete_frame, last_frame_size, 0);
+
+    print_stats(&rx.stats);
+
+    if (capture_file) {
+        capture_close(&capture);
     }
-    
-    print_stats(&stats);
-    
-    free(frame_buffer);
-    free(last_complete_frame);
-    close(sockfd);
+    trace_close();
+    free_receiver(&rx);
+    transport_close(&transport);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <string.h>
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+// Only when built for a CPU with the CRC extension (e.g. -march=armv8-a+crc)
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
+#define CRC32C_POLY 0x82F63B78u     // reflected Castagnoli polynomial
+
+static uint32_t table[8][256];
+static int table_ready = 0;
+
+static void init_table(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t crc = n;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        table[0][n] = crc;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int t = 1; t < 8; t++) {
+            table[t][n] = (table[t - 1][n] >> 8) ^ table[0][table[t - 1][n] & 0xFF];
+        }
+    }
+    table_ready = 1;
+}
+
+// Slicing-by-8: one 8-byte word per step through eight table lookups
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *data, size_t len) {
+    if (!table_ready) {
+        init_table();
+    }
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint32_t low, high;
+        memcpy(&low, data + i, sizeof(low));
+        memcpy(&high, data + i + 4, sizeof(high));
+        low ^= crc;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^
+              table[5][(low >> 16) & 0xFF] ^ table[4][low >> 24] ^
+              table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF] ^
+              table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+    }
+    for (; i < len; i++) {
+        crc = (crc >> 8) ^ table[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+// Built for SSE4.2 on its own so the rest of the program keeps the
+// baseline instruction set; only called after the CPU check below
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *data, size_t len) {
+    size_t i = 0;
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for (; i + 4 <= len; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc = _mm_crc32_u32(crc, word);
+    }
+    for (; i < len; i++) {
+        crc = _mm_crc32_u8(crc, data[i]);
+    }
+    return crc;
+}
+#endif
+
+#ifdef CRC32C_ARM
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *data, size_t len) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; i < len; i++) {
+        crc = __crc32cb(crc, data[i]);
+    }
+    return crc;
+}
+#endif
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const uint8_t *data, size_t len);
+
+static crc32c_fn implementation = NULL;
+static const char *implementation_name = NULL;
+
+static void select_implementation(void) {
+#if defined(CRC32C_X86)
+    if (__builtin_cpu_supports("sse4.2")) {
+        implementation_name = "sse4.2";
+        implementation = crc32c_sse42;
+        return;
+    }
+#elif defined(CRC32C_ARM)
+    implementation_name = "armv8-crc";
+    implementation = crc32c_armv8;
+    return;
+#endif
+    implementation_name = "table";
+    implementation = crc32c_table;
+}
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t len) {
+    if (!implementation) {
+        select_implementation();
+    }
+    return ~implementation(~crc, data, len);
+}
+
+const char *crc32c_implementation(void) {
+    if (!implementation) {
+        select_implementation();
+    }
+    return implementation_name;
+}
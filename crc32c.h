@@ -0,0 +1,17 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-32C (Castagnoli), the checksum iSCSI and SCTP use, computed with the
+// SSE4.2 crc32 instruction or the ARMv8 CRC extension where available and
+// slicing-by-8 tables otherwise. crc is the value returned for the bytes
+// before data (0 to start), so a frame can be checksummed chunk by chunk:
+// crc32c(crc32c(0, a, n), b, m) equals the checksum of a followed by b.
+uint32_t crc32c(uint32_t crc, const uint8_t *data, size_t len);
+
+// Name of the implementation crc32c() uses on this machine
+const char *crc32c_implementation(void);
+
+#endif // CRC32C_H
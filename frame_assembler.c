@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_assembler.h"
+#include "crc32c.h"
+
+#define INTERVAL_MISSING 0
+#define INTERVAL_COMPLETE 1
+#define INTERVAL_PARTIAL 2   // split interval, fragments contiguous so far
+#define INTERVAL_BROKEN 3    // split interval with a fragment missing
+
+void init_frame_assembler(frame_assembler_t *fa, uint8_t *buffer, size_t capacity) {
+    memset(fa, 0, sizeof(frame_assembler_t));
+    fa->data = buffer;
+    fa->capacity = capacity;
+}
+
+void free_frame_assembler(frame_assembler_t *fa) {
+    free(fa->interval_starts);
+    free(fa->interval_ends);
+    free(fa->interval_state);
+    fa->interval_starts = NULL;
+    fa->interval_ends = NULL;
+    fa->interval_state = NULL;
+    fa->interval_capacity = 0;
+}
+
+// The received-range bookkeeping means the frame buffer never needs clearing
+void reset_frame_assembler(frame_assembler_t *fa) {
+    fa->frame_length = 0;
+    fa->bytes_received = 0;
+    fa->fragment_count = 0;
+    fa->has_base = 0;
+    fa->crc = 0;
+    fa->crc_length = 0;
+}
+
+// Extends the running CRC while the frame is filled front to back. Bytes
+// ahead of the fragment are only final yet if they came from a reference.
+static void update_crc(frame_assembler_t *fa, size_t offset, size_t len) {
+    if (offset < fa->crc_length) {
+        // Rewrote bytes already checksummed, start over when the frame completes
+        fa->crc = 0;
+        fa->crc_length = 0;
+        return;
+    }
+    if (offset > fa->crc_length) {
+        if (!fa->has_base) {
+            return;
+        }
+        fa->crc = crc32c(fa->crc, fa->data + fa->crc_length, offset - fa->crc_length);
+    }
+    fa->crc = crc32c(fa->crc, fa->data + offset, len);
+    fa->crc_length = offset + len;
+}
+
+static int is_duplicate(frame_assembler_t *fa, uint32_t offset) {
+    for (int i = fa->fragment_count - 1; i >= 0; i--) {
+        if (fa->fragments[i].offset == offset) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int frame_assembler_add(frame_assembler_t *fa, jpeg_payload_header_t *header,
+                        uint8_t *data, size_t len) {
+    if (fa->frame_length == 0) {
+        if (header->frame_length == 0 || header->frame_length > fa->capacity) {
+            return -1;
+        }
+        fa->frame_length = header->frame_length;
+    }
+
+    if (header->frame_length != fa->frame_length ||
+        (size_t)header->fragment_offset + len > fa->frame_length ||
+        fa->fragment_count >= MAX_FRAME_FRAGMENTS) {
+        return -1;
+    }
+
+    // Fragments normally arrive in offset order, so only out-of-order ones
+    // need the full duplicate check
+    if (fa->fragment_count > 0) {
+        fragment_info_t *last = &fa->fragments[fa->fragment_count - 1];
+        if (header->fragment_offset < last->offset + last->length &&
+            is_duplicate(fa, header->fragment_offset)) {
+            return 0;
+        }
+    }
+
+    memcpy(fa->data + header->fragment_offset, data, len);
+    update_crc(fa, header->fragment_offset, len);
+
+    fragment_info_t *fragment = &fa->fragments[fa->fragment_count++];
+    fragment->offset = header->fragment_offset;
+    fragment->length = (uint32_t)len;
+    fragment->restart_count = header->restart_count;
+    fragment->restart_flags = header->restart_flags;
+    fragment->type = header->type;
+    fa->bytes_received += len;
+    return 0;
+}
+
+int frame_assembler_set_base(frame_assembler_t *fa, const uint8_t *base, size_t len,
+                             size_t delta_length) {
+    if (len == 0 || len > fa->capacity || delta_length > len) {
+        return -1;
+    }
+    memcpy(fa->data, base, len);
+    fa->frame_length = len;
+    fa->bytes_received = len - delta_length;
+    fa->has_base = 1;
+    return 0;
+}
+
+int frame_assembler_complete(frame_assembler_t *fa) {
+    return fa->frame_length > 0 && fa->bytes_received == fa->frame_length;
+}
+
+uint32_t frame_assembler_crc(frame_assembler_t *fa) {
+    if (fa->crc_length < fa->frame_length) {
+        fa->crc = crc32c(fa->crc, fa->data + fa->crc_length, fa->frame_length - fa->crc_length);
+        fa->crc_length = fa->frame_length;
+    }
+    return fa->crc;
+}
+
+static void sort_fragments(frame_assembler_t *fa) {
+    for (int i = 1; i < fa->fragment_count; i++) {
+        fragment_info_t current = fa->fragments[i];
+        int j = i - 1;
+        while (j >= 0 && fa->fragments[j].offset > current.offset) {
+            fa->fragments[j + 1] = fa->fragments[j];
+            j--;
+        }
+        fa->fragments[j + 1] = current;
+    }
+}
+
+// Bytes received contiguously from the start of the frame
+static size_t received_prefix(frame_assembler_t *fa) {
+    sort_fragments(fa);
+    size_t prefix = 0;
+    for (int i = 0; i < fa->fragment_count; i++) {
+        fragment_info_t *fragment = &fa->fragments[i];
+        if (fragment->offset <= prefix && fragment->offset + fragment->length > prefix) {
+            prefix = fragment->offset + fragment->length;
+        }
+    }
+    return prefix;
+}
+
+size_t frame_assembler_base_scans(frame_assembler_t *fa, uint8_t *out, size_t out_capacity) {
+    // The fragment flagged as the last base fragment says where the base ends
+    size_t base_end = 0;
+    for (int i = 0; i < fa->fragment_count; i++) {
+        fragment_info_t *fragment = &fa->fragments[i];
+        if (fragment->type == JPEG_FRAGMENT_BASE && (fragment->restart_flags & JPEG_BASE_LAST)) {
+            base_end = fragment->offset + fragment->length;
+        }
+    }
+    if (base_end == 0) {
+        return 0;
+    }
+
+    size_t prefix = received_prefix(fa);
+    if (prefix < base_end) {
+        return 0;
+    }
+    // The sender cuts the base on a scan boundary, which a prefix ending
+    // exactly there cannot show (the next marker is not in it yet)
+    size_t length = jpeg_complete_scans_length(fa->data, prefix);
+    if (length < base_end) length = base_end;
+    if (length + 2 > out_capacity) {
+        return 0;
+    }
+    memcpy(out, fa->data, length);
+    out[length] = 0xFF;
+    out[length + 1] = JPEG_MARKER_EOI;
+    return length + 2;
+}
+
+static int is_whole_intervals(fragment_info_t *fragment) {
+    return (fragment->restart_flags & (JPEG_RESTART_FIRST | JPEG_RESTART_LAST)) ==
+           (JPEG_RESTART_FIRST | JPEG_RESTART_LAST);
+}
+
+// Number of restart intervals that end inside a whole-interval fragment
+static int count_restart_markers(uint8_t *data, fragment_info_t *fragment) {
+    int count = 0;
+    size_t end = fragment->offset + fragment->length;
+    for (size_t pos = fragment->offset; pos + 1 < end; pos++) {
+        if (data[pos] == 0xFF && data[pos + 1] >= JPEG_MARKER_RST0 &&
+            data[pos + 1] <= JPEG_MARKER_RST7) {
+            count++;
+            pos++;
+        }
+    }
+    return count;
+}
+
+// One past the last interval a scan fragment shows the frame to have. A
+// whole-interval fragment that ends right after a restart marker is
+// followed by one more interval, unless nothing of the frame is left.
+static int fragment_interval_end(frame_assembler_t *fa, fragment_info_t *fragment) {
+    if (!is_whole_intervals(fragment)) {
+        return fragment->restart_count + 1;
+    }
+    size_t end = fragment->offset + fragment->length;
+    int markers = count_restart_markers(fa->data, fragment);
+    int ends_on_marker = end >= 2 && fa->data[end - 2] == 0xFF &&
+                         fa->data[end - 1] >= JPEG_MARKER_RST0 && fa->data[end - 1] <= JPEG_MARKER_RST7;
+    if (ends_on_marker && end >= fa->frame_length) {
+        return fragment->restart_count + markers;
+    }
+    return fragment->restart_count + markers + 1;
+}
+
+static int append(uint8_t *out, size_t out_capacity, size_t *out_len,
+                  const uint8_t *src, size_t len) {
+    if (*out_len + len > out_capacity) {
+        return -1;
+    }
+    memcpy(out + *out_len, src, len);
+    *out_len += len;
+    return 0;
+}
+
+static int grow_interval_scratch(frame_assembler_t *fa, int count) {
+    uint32_t *starts = (uint32_t*)realloc(fa->interval_starts, sizeof(uint32_t) * count);
+    if (starts) fa->interval_starts = starts;
+    uint32_t *ends = (uint32_t*)realloc(fa->interval_ends, sizeof(uint32_t) * count);
+    if (ends) fa->interval_ends = ends;
+    uint8_t *state = (uint8_t*)realloc(fa->interval_state, count);
+    if (state) fa->interval_state = state;
+    if (!starts || !ends || !state) {
+        return -1;
+    }
+    fa->interval_capacity = count;
+    return 0;
+}
+
+size_t frame_assembler_conceal(frame_assembler_t *fa, uint8_t *reference,
+                               jpeg_layout_t *reference_layout, uint8_t *out,
+                               size_t out_capacity, int *intervals_concealed) {
+    *intervals_concealed = 0;
+    int have_reference = reference != NULL && reference_layout->frame_length > 0;
+
+    if (fa->fragment_count == 0) {
+        return 0;
+    }
+
+    size_t prefix = received_prefix(fa);
+    int interval_count = 0;
+    for (int i = 0; i < fa->fragment_count; i++) {
+        fragment_info_t *fragment = &fa->fragments[i];
+        if (fragment->type == JPEG_FRAGMENT_SCAN) {
+            int end = fragment_interval_end(fa, fragment);
+            if (end > interval_count) interval_count = end;
+        }
+    }
+
+    // Without restart intervals the best decodable substitute is the last frame
+    if (interval_count == 0) {
+        if (!have_reference || reference_layout->frame_length > out_capacity) {
+            return 0;
+        }
+        memcpy(out, reference, reference_layout->frame_length);
+        return reference_layout->frame_length;
+    }
+
+    // Intervals only line up with the reference if both frames share headers
+    size_t header_end = jpeg_header_length(fa->data, prefix);
+    int compatible = have_reference && reference_layout->interval_count > 0;
+    uint8_t *header_src = fa->data;
+    if (header_end > 0) {
+        compatible = compatible && reference_layout->header_end == header_end &&
+                     memcmp(reference, fa->data, header_end) == 0;
+    } else if (compatible) {
+        header_src = reference;
+        header_end = reference_layout->header_end;
+    } else {
+        return 0;
+    }
+
+    // Identical headers mean identical dimensions and restart interval, so
+    // the reference's layout gives the frame's actual interval count
+    if (compatible) {
+        interval_count = reference_layout->interval_count;
+    }
+
+    if (interval_count > fa->interval_capacity && grow_interval_scratch(fa, interval_count) < 0) {
+        return 0;
+    }
+    uint32_t *starts = fa->interval_starts;
+    uint32_t *ends = fa->interval_ends;
+    uint8_t *state = fa->interval_state;
+    memset(state, INTERVAL_MISSING, interval_count);
+
+    for (int i = 0; i < fa->fragment_count; i++) {
+        fragment_info_t *fragment = &fa->fragments[i];
+        if (fragment->type != JPEG_FRAGMENT_SCAN) continue;
+
+        int k = fragment->restart_count;
+        size_t end = fragment->offset + fragment->length;
+        if (k >= interval_count) continue;
+
+        if (is_whole_intervals(fragment)) {
+            size_t interval_start = fragment->offset;
+            for (size_t pos = fragment->offset; pos + 1 < end && k < interval_count; pos++) {
+                if (fa->data[pos] == 0xFF && fa->data[pos + 1] >= JPEG_MARKER_RST0 &&
+                    fa->data[pos + 1] <= JPEG_MARKER_RST7) {
+                    starts[k] = (uint32_t)interval_start;
+                    ends[k] = (uint32_t)(pos + 2);
+                    state[k++] = INTERVAL_COMPLETE;
+                    interval_start = pos + 2;
+                    pos++;
+                }
+            }
+            if (interval_start < end && k < interval_count) {
+                starts[k] = (uint32_t)interval_start;
+                ends[k] = (uint32_t)end;
+                state[k] = INTERVAL_COMPLETE;
+            }
+            continue;
+        }
+
+        if (fragment->restart_flags & JPEG_RESTART_FIRST) {
+            starts[k] = fragment->offset;
+            ends[k] = (uint32_t)end;
+            state[k] = INTERVAL_PARTIAL;
+        } else if (state[k] == INTERVAL_PARTIAL && ends[k] == fragment->offset) {
+            ends[k] = (uint32_t)end;
+        } else {
+            state[k] = INTERVAL_BROKEN;
+        }
+        if ((fragment->restart_flags & JPEG_RESTART_LAST) && state[k] == INTERVAL_PARTIAL) {
+            state[k] = INTERVAL_COMPLETE;
+        }
+    }
+
+    size_t out_len = 0;
+    int failed = append(out, out_capacity, &out_len, header_src, header_end);
+
+    for (int k = 0; k < interval_count && !failed; k++) {
+        if (state[k] == INTERVAL_COMPLETE) {
+            failed = append(out, out_capacity, &out_len, fa->data + starts[k], ends[k] - starts[k]);
+            continue;
+        }
+
+        (*intervals_concealed)++;
+        // Without a matching reference the interval is left out and the
+        // decoder resynchronises on the next restart marker
+        if (compatible && k < reference_layout->interval_count) {
+            size_t ref_start = reference_layout->interval_starts[k];
+            size_t ref_end = (k + 1 < reference_layout->interval_count) ?
+                             reference_layout->interval_starts[k + 1] : reference_layout->frame_length;
+            failed = append(out, out_capacity, &out_len, reference + ref_start, ref_end - ref_start);
+        }
+    }
+
+    if (!failed && (out_len < 2 || out[out_len - 2] != 0xFF || out[out_len - 1] != JPEG_MARKER_EOI)) {
+        const uint8_t eoi[2] = {0xFF, JPEG_MARKER_EOI};
+        failed = append(out, out_capacity, &out_len, eoi, sizeof(eoi));
+    }
+
+    return failed ? 0 : out_len;
+}
@@ -0,0 +1,75 @@
+#ifndef FRAME_ASSEMBLER_H
+#define FRAME_ASSEMBLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "jpeg_payload.h"
+
+#define MAX_FRAME_FRAGMENTS 8192
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    uint16_t restart_count;
+    uint8_t restart_flags;
+    uint8_t type;
+} fragment_info_t;
+
+// Places JPEG fragments at their payload-header offsets and remembers which
+// ranges arrived, so a frame with holes can still be turned into a
+// decodable image when its time is up.
+typedef struct {
+    uint8_t *data;
+    size_t capacity;
+    size_t frame_length;    // from the payload header, 0 until the first fragment
+    size_t bytes_received;
+    fragment_info_t fragments[MAX_FRAME_FRAGMENTS];
+    int fragment_count;
+    int has_base;           // started from a cached reference
+    uint32_t crc;           // CRC-32C of the first crc_length bytes
+    size_t crc_length;
+
+    // Concealment scratch, grown to the most restart intervals seen
+    uint32_t *interval_starts;
+    uint32_t *interval_ends;
+    uint8_t *interval_state;
+    int interval_capacity;
+} frame_assembler_t;
+
+void init_frame_assembler(frame_assembler_t *fa, uint8_t *buffer, size_t capacity);
+void free_frame_assembler(frame_assembler_t *fa);
+void reset_frame_assembler(frame_assembler_t *fa);
+
+// Returns -1 if the fragment does not fit the frame it claims to belong to
+int frame_assembler_add(frame_assembler_t *fa, jpeg_payload_header_t *header,
+                        uint8_t *data, size_t len);
+
+// Starts the frame from a copy of a cached reference, counting every byte
+// as received except the delta_length bytes the sender says it changed.
+// Returns -1 if the reference does not fit the buffer.
+int frame_assembler_set_base(frame_assembler_t *fa, const uint8_t *base, size_t len,
+                             size_t delta_length);
+
+int frame_assembler_complete(frame_assembler_t *fa);
+
+// CRC-32C of a complete frame. Fragments that arrive in offset order are
+// checksummed as they are copied in, so this only covers whatever came
+// out of order or from the reference and was not reached yet.
+uint32_t frame_assembler_crc(frame_assembler_t *fa);
+
+// Builds a decodable JPEG from an incomplete frame into `out`. Missing
+// restart intervals are filled from the same intervals of the reference
+// (previously delivered) frame when the two share headers; frames without
+// restart intervals fall back to repeating the reference. Returns the
+// output size, or 0 if nothing decodable can be produced.
+size_t frame_assembler_conceal(frame_assembler_t *fa, uint8_t *reference,
+                               jpeg_layout_t *reference_layout, uint8_t *out,
+                               size_t out_capacity, int *intervals_concealed);
+
+// Builds a lower-quality JPEG from an incomplete progressive frame whose
+// base scans all arrived: the received prefix cut after its last complete
+// scan, then EOI. Returns the output size, or 0 if a base scan is missing
+// or the frame is not a prioritised progressive one.
+size_t frame_assembler_base_scans(frame_assembler_t *fa, uint8_t *out, size_t out_capacity);
+
+#endif // FRAME_ASSEMBLER_H
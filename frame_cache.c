@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frame_cache.h"
+
+void init_frame_cache(frame_cache_t *cache) {
+    memset(cache, 0, sizeof(frame_cache_t));
+}
+
+void free_frame_cache(frame_cache_t *cache) {
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        free(cache->entries[i].data);
+    }
+    memset(cache, 0, sizeof(frame_cache_t));
+}
+
+cached_frame_t* frame_cache_get(frame_cache_t *cache, uint64_t hash) {
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        cached_frame_t *entry = &cache->entries[i];
+        if (entry->valid && entry->hash == hash) {
+            entry->last_used = ++cache->use_counter;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int frame_cache_put(frame_cache_t *cache, uint64_t hash, const uint8_t *data, size_t len) {
+    if (frame_cache_get(cache, hash)) {
+        return 0;
+    }
+
+    cached_frame_t *victim = &cache->entries[0];
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        cached_frame_t *entry = &cache->entries[i];
+        if (!entry->valid) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_used < victim->last_used) {
+            victim = entry;
+        }
+    }
+
+    if (len > victim->capacity) {
+        uint8_t *grown = (uint8_t*)realloc(victim->data, len);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to allocate %zu bytes for cached frame\n", len);
+            victim->valid = 0;
+            return -1;
+        }
+        victim->data = grown;
+        victim->capacity = len;
+    }
+
+    memcpy(victim->data, data, len);
+    victim->hash = hash;
+    victim->length = len;
+    victim->valid = 1;
+    victim->last_used = ++cache->use_counter;
+    return 0;
+}
+
+void init_region_cache(region_cache_t *cache) {
+    memset(cache, 0, sizeof(region_cache_t));
+}
+
+void free_region_cache(region_cache_t *cache) {
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        free(cache->entries[i].region_hashes);
+    }
+    memset(cache, 0, sizeof(region_cache_t));
+}
+
+cached_regions_t* region_cache_get(region_cache_t *cache, uint64_t hash) {
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        cached_regions_t *entry = &cache->entries[i];
+        if (entry->valid && entry->hash == hash) {
+            entry->last_used = ++cache->use_counter;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int region_cache_put(region_cache_t *cache, uint64_t hash, size_t frame_length,
+                     const uint64_t *region_hashes, size_t region_count) {
+    if (region_cache_get(cache, hash)) {
+        return 0;
+    }
+
+    cached_regions_t *victim = &cache->entries[0];
+    for (int i = 0; i < FRAME_CACHE_SIZE; i++) {
+        cached_regions_t *entry = &cache->entries[i];
+        if (!entry->valid) {
+            victim = entry;
+            break;
+        }
+        if (entry->last_used < victim->last_used) {
+            victim = entry;
+        }
+    }
+
+    if (region_count > victim->capacity) {
+        uint64_t *grown = (uint64_t*)realloc(victim->region_hashes, sizeof(uint64_t) * region_count);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to allocate %zu region hashes for cached frame\n", region_count);
+            victim->valid = 0;
+            return -1;
+        }
+        victim->region_hashes = grown;
+        victim->capacity = region_count;
+    }
+
+    memcpy(victim->region_hashes, region_hashes, sizeof(uint64_t) * region_count);
+    victim->hash = hash;
+    victim->frame_length = frame_length;
+    victim->region_count = region_count;
+    victim->valid = 1;
+    victim->last_used = ++cache->use_counter;
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_CACHE_SIZE 4
+
+typedef struct {
+    uint64_t hash;          // frame_hash() of the data
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+    uint64_t last_used;
+    int valid;
+} cached_frame_t;
+
+// A few recent frames looked up by content hash. The client keeps the
+// frames it acknowledged so repeat and delta frames can be rebuilt from
+// them.
+typedef struct {
+    cached_frame_t entries[FRAME_CACHE_SIZE];
+    uint64_t use_counter;
+} frame_cache_t;
+
+typedef struct {
+    uint64_t hash;              // frame_hash() of the frame
+    size_t frame_length;
+    uint64_t *region_hashes;    // one per FRAME_REGION_SIZE region of the frame
+    size_t region_count;
+    size_t capacity;            // region hashes there is room for
+    uint64_t last_used;
+    int valid;
+} cached_regions_t;
+
+// The server's counterpart: for each recent frame it sent, only the region
+// hashes needed to pick the regions a later frame changed, so an
+// acknowledgement can be turned into a delta reference.
+typedef struct {
+    cached_regions_t entries[FRAME_CACHE_SIZE];
+    uint64_t use_counter;
+} region_cache_t;
+
+void init_frame_cache(frame_cache_t *cache);
+void free_frame_cache(frame_cache_t *cache);
+
+// Returns NULL if no cached frame has this hash
+cached_frame_t* frame_cache_get(frame_cache_t *cache, uint64_t hash);
+
+// Copies the frame in unless it is already cached, evicting the least
+// recently used entry. Returns -1 if the copy could not be allocated.
+int frame_cache_put(frame_cache_t *cache, uint64_t hash, const uint8_t *data, size_t len);
+
+void init_region_cache(region_cache_t *cache);
+void free_region_cache(region_cache_t *cache);
+
+// Returns NULL if no frame with this hash is cached
+cached_regions_t* region_cache_get(region_cache_t *cache, uint64_t hash);
+
+// Copies the region hashes in unless the frame is already cached, evicting
+// the least recently used entry. Returns -1 if the copy could not be
+// allocated.
+int region_cache_put(region_cache_t *cache, uint64_t hash, size_t frame_length,
+                     const uint64_t *region_hashes, size_t region_count);
+
+#endif // FRAME_CACHE_H
@@ -0,0 +1,45 @@
+#include <string.h>
+#include "frame_hash.h"
+
+#define HASH_OFFSET 0xcbf29ce484222325ULL
+#define HASH_PRIME 0x100000001b3ULL
+
+static uint64_t mix(uint64_t hash, uint64_t word) {
+    hash = (hash ^ word) * HASH_PRIME;
+    return hash ^ (hash >> 32);
+}
+
+uint64_t hash_bytes(const uint8_t *data, size_t len) {
+    uint64_t hash = HASH_OFFSET;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = mix(hash, word);
+    }
+    for (; i < len; i++) {
+        hash = mix(hash, data[i]);
+    }
+    return mix(hash, len);
+}
+
+size_t frame_region_count(size_t len) {
+    return (len + FRAME_REGION_SIZE - 1) / FRAME_REGION_SIZE;
+}
+
+uint64_t frame_hash(const uint8_t *data, size_t len, uint64_t *region_hashes) {
+    uint64_t hash = HASH_OFFSET;
+    size_t regions = frame_region_count(len);
+
+    for (size_t r = 0; r < regions; r++) {
+        size_t start = r * FRAME_REGION_SIZE;
+        size_t size = (len - start < FRAME_REGION_SIZE) ? len - start : FRAME_REGION_SIZE;
+        uint64_t region_hash = hash_bytes(data + start, size);
+        if (region_hashes) {
+            region_hashes[r] = region_hash;
+        }
+        hash = mix(hash, region_hash);
+    }
+    return mix(hash, len);
+}
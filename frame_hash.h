@@ -0,0 +1,22 @@
+#ifndef FRAME_HASH_H
+#define FRAME_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FRAME_REGION_SIZE 1024  // granularity of delta transmission
+
+// Fast non-cryptographic 64-bit hash (FNV-1a over 8-byte words with an
+// extra shift to carry high bits down). Good enough to tell frames apart,
+// not to resist deliberate collisions.
+uint64_t hash_bytes(const uint8_t *data, size_t len);
+
+size_t frame_region_count(size_t len);
+
+// Hashes every FRAME_REGION_SIZE region of the frame into region_hashes
+// (frame_region_count(len) entries, may be NULL) and returns the frame
+// hash, which covers the region hashes and the frame length. Sender and
+// receiver both identify frames by this value.
+uint64_t frame_hash(const uint8_t *data, size_t len, uint64_t *region_hashes);
+
+#endif // FRAME_HASH_H
@@ -3,46 +3,104 @@
 #include <time.h>    
 #include <sys/time.h> 
 #include "jitter_buffer.h"
+#include "buffer_config.h"
 #include "time_utils.h"
 
 
-void init_jitter_buffer(jitter_buffer_t *jb) {
+int init_jitter_buffer(jitter_buffer_t *jb, int capacity, arena_t *arena) {
     memset(jb, 0, sizeof(jitter_buffer_t));
+    jb->arena = arena;
+    jb->slot_size = JITTER_SLOT_SIZE;
+    if (capacity < JITTER_BUFFER_SIZE) capacity = JITTER_BUFFER_SIZE;
+
+    jb->buffer = (buffered_packet_t*)calloc(capacity, sizeof(buffered_packet_t));
+    if (!jb->buffer) {
+        fprintf(stderr, "Error: Failed to allocate jitter buffer of %d packets\n", capacity);
+        return -1;
+    }
+    jb->capacity = capacity;
     jb->head = 0;
     jb->tail = 0;
     jb->count = 0;
-    
-    for (int i = 0; i < JITTER_BUFFER_SIZE; i++) {
-        jb->buffer[i].valid = 0;
-        jb->buffer[i].packet_size = 0;
-        jb->buffer[i].arrival_time.tv_sec = 0;
-        jb->buffer[i].arrival_time.tv_usec = 0;
+    return 0;
+}
+
+void free_jitter_buffer(jitter_buffer_t *jb) {
+    for (int i = 0; i < jb->capacity; i++) {
+        arena_release(jb->arena, jb->buffer[i].packet);
+    }
+    free(jb->buffer);
+    jb->buffer = NULL;
+    jb->capacity = 0;
+    jb->count = 0;
+}
+
+// Unrolls the ring into a larger one so the oldest packet is at index 0
+static int grow(jitter_buffer_t *jb) {
+    size_t capacity = buffer_grow_capacity(jb->capacity, jb->capacity + 1, BUFFER_MAX_PACKETS);
+    if (capacity <= (size_t)jb->capacity) {
+        return -1;
+    }
+
+    // The ring itself is on the heap: the arena could never take the old
+    // one back, and growing only follows sustained overflow
+    buffered_packet_t *grown = (buffered_packet_t*)calloc(capacity, sizeof(buffered_packet_t));
+    if (!grown) {
+        return -1;
     }
+    for (int i = 0; i < jb->capacity; i++) {
+        grown[i] = jb->buffer[(jb->tail + i) % jb->capacity];
+    }
+    free(jb->buffer);
+    jb->buffer = grown;
+    jb->tail = 0;
+    jb->head = jb->count;
+    jb->capacity = (int)capacity;
+    jb->resizes++;
+
+    printf("Jitter buffer full: grown to %d packets\n", jb->capacity);
+    return 0;
 }
 
 
 int jitter_buffer_add(jitter_buffer_t *jb, rtp_packet_t *packet, size_t size) {
-    if (jb->count >= JITTER_BUFFER_SIZE) {
+    if (jb->count >= jb->capacity &&
+        (!buffer_overflow_sustained(&jb->overflow) || grow(jb) < 0)) {
         printf("Warning: Jitter buffer full!\n");
         return -1;
     }
     
     int current_index = jb->head; 
+    buffered_packet_t *slot = &jb->buffer[current_index];
 
-    memcpy(&jb->buffer[current_index].packet, packet, size);
+    // Slots follow the negotiated datagram size rather than reserving 64 KB
+    // each. Carving at the largest size seen means that once the size
+    // settles each slot is carved at most once more.
+    if (size > slot->slot_capacity) {
+        if (size > jb->slot_size) jb->slot_size = size;
+        rtp_packet_t *grown = (rtp_packet_t*)arena_realloc(jb->arena, slot->packet, 0, jb->slot_size);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to grow jitter buffer slot to %zu bytes\n", size);
+            return -1;
+        }
+        slot->packet = grown;
+        slot->slot_capacity = jb->slot_size;
+    }
+
+    memcpy(slot->packet, packet, size);
     
-    get_monotonic_time(&jb->buffer[current_index].arrival_time);
+    get_monotonic_time(&slot->arrival_time);
     
-    jb->buffer[current_index].packet_size = size;
-    jb->buffer[current_index].valid = 1;
+    slot->packet_size = size;
+    slot->valid = 1;
 
-    jb->head = (jb->head + 1) % JITTER_BUFFER_SIZE;
+    jb->head = (jb->head + 1) % jb->capacity;
     jb->count++;
     
     printf("Added packet to Jitter Buffer. Current Count: %d, arrival_time: %ld.%06ld\n", 
            jb->count, 
-           (long)jb->buffer[current_index].arrival_time.tv_sec,
-           (long)jb->buffer[current_index].arrival_time.tv_usec);
+           (long)slot->arrival_time.tv_sec,
+           (long)slot->arrival_time.tv_usec);
     
     return 0;
 }
@@ -61,9 +119,10 @@ rtp_packet_t* jitter_buffer_get(jitter_buffer_t *jb, size_t *size) {
 
     if (elapsed >= JITTER_DELAY_MS) {
         *size = jb->buffer[jb->tail].packet_size;
-        rtp_packet_t *packet = &jb->buffer[jb->tail].packet;
+        rtp_packet_t *packet = jb->buffer[jb->tail].packet;
+        jb->last_arrival = jb->buffer[jb->tail].arrival_time;
         jb->buffer[jb->tail].valid = 0;
-        jb->tail = (jb->tail + 1) % JITTER_BUFFER_SIZE;
+        jb->tail = (jb->tail + 1) % jb->capacity;
         jb->count--;
 
         return packet;
@@ -71,3 +130,40 @@ rtp_packet_t* jitter_buffer_get(jitter_buffer_t *jb, size_t *size) {
 
     return NULL;  
 }
+
+uint32_t jitter_buffer_oldest_timestamp(jitter_buffer_t *jb) {
+    if (jb->count == 0) {
+        return 0;
+    }
+    return ntohl(jb->buffer[jb->tail].packet->header.timestamp);
+}
+
+int jitter_buffer_discard_before(jitter_buffer_t *jb, uint32_t keep_timestamp, int *packets_dropped) {
+    int kept = 0;
+    int frames = 0;
+    uint32_t last_dropped = 0;
+
+    // Slots own their packet allocations, so survivors are swapped down
+    // rather than copied
+    for (int i = 0; i < jb->count; i++) {
+        int index = (jb->tail + i) % jb->capacity;
+        uint32_t timestamp = ntohl(jb->buffer[index].packet->header.timestamp);
+        if (rtp_timestamp_before(timestamp, keep_timestamp)) {
+            if (frames == 0 || timestamp != last_dropped) frames++;
+            last_dropped = timestamp;
+            jb->buffer[index].valid = 0;
+            (*packets_dropped)++;
+            continue;
+        }
+        int target = (jb->tail + kept++) % jb->capacity;
+        if (target != index) {
+            buffered_packet_t slot = jb->buffer[target];
+            jb->buffer[target] = jb->buffer[index];
+            jb->buffer[index] = slot;
+        }
+    }
+
+    jb->count = kept;
+    jb->head = (jb->tail + kept) % jb->capacity;
+    return frames;
+}
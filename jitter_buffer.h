@@ -6,13 +6,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include "rtp.h" 
+#include "arena.h"
+#include "buffer_config.h"
 
-#define JITTER_BUFFER_SIZE 50
+#define JITTER_BUFFER_SIZE 50   // minimum capacity in packets, see buffer_config.h
 #define JITTER_DELAY_MS 8 
+#define JITTER_SLOT_SIZE 2048   // initial slot size, grown to the largest packet seen
 
 
 typedef struct {
-    rtp_packet_t packet;
+    rtp_packet_t *packet;   // slot_capacity bytes, only packet_size of them used
+    size_t slot_capacity;
     struct timeval arrival_time;
     size_t packet_size;
     int valid;
@@ -20,16 +24,25 @@ typedef struct {
 
 
 typedef struct {
-    buffered_packet_t buffer[JITTER_BUFFER_SIZE];
+    buffered_packet_t *buffer;
+    int capacity;
+    arena_t *arena;         // slot memory, NULL for the heap
+    size_t slot_size;       // largest packet seen, what new slots are carved at
     int head;  // Next position to write
     int tail;  // Next position to read
     int count; // Number of packets in buffer
+    struct timeval last_arrival; // arrival of the packet jitter_buffer_get last returned
+    int resizes;
+    buffer_overflow_t overflow; // when to grow rather than drop
 } jitter_buffer_t;
 
 
-void init_jitter_buffer(jitter_buffer_t *jb);
-
+// Slots are carved from arena (NULL for the heap) as they are first used
+int init_jitter_buffer(jitter_buffer_t *jb, int capacity, arena_t *arena);
+void free_jitter_buffer(jitter_buffer_t *jb);
 
+// A full buffer drops the packet, unless it keeps filling up: then it
+// doubles (up to BUFFER_MAX_PACKETS)
 int jitter_buffer_add(jitter_buffer_t *jb, rtp_packet_t *packet, size_t size);
 
 
@@ -37,4 +50,12 @@ long time_diff_ms(struct timeval *start, struct timeval *end);
 
 rtp_packet_t* jitter_buffer_get(jitter_buffer_t *jb, size_t *size);
 
+// RTP timestamp of the next packet to be released, 0 if empty
+uint32_t jitter_buffer_oldest_timestamp(jitter_buffer_t *jb);
+
+// Drops every packet of a frame older than keep_timestamp, keeping the
+// rest in arrival order. Returns the number of frames dropped and adds the
+// packets to *packets_dropped.
+int jitter_buffer_discard_before(jitter_buffer_t *jb, uint32_t keep_timestamp, int *packets_dropped);
+
 #endif // JITTER_BUFFER_H
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "jpeg_payload.h"
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_SOF1 0xC1
+#define JPEG_MARKER_SOF2 0xC2
+#define JPEG_MARKER_TEM 0x01
+
+// Base scans carry DC and the lowest AC coefficients (in zigzag order);
+// a scan starting above this only adds detail
+#define JPEG_BASE_MAX_START 5
+
+
+static int is_restart_marker(uint8_t marker) {
+    return marker >= JPEG_MARKER_RST0 && marker <= JPEG_MARKER_RST7;
+}
+
+// Walks the entropy-coded data after SOS and records where each restart
+// interval starts. Returns the number of intervals, or 0 if the scan is not
+// followed directly by EOI (multi-scan images are sent unaligned).
+static int find_restart_intervals(const uint8_t *jpeg, size_t len, jpeg_layout_t *layout) {
+    int count = 1;
+    size_t pos = layout->header_end;
+
+    for (int pass = 0; pass < 2; pass++) {
+        count = 1;
+        for (pos = layout->header_end; pos + 1 < len; pos++) {
+            if (jpeg[pos] != 0xFF) continue;
+            uint8_t marker = jpeg[pos + 1];
+            if (marker == 0x00 || marker == 0xFF) continue; // stuffed byte or fill
+            if (!is_restart_marker(marker)) break;
+            if (pass == 1) {
+                layout->interval_starts[count] = (uint32_t)(pos + 2);
+            }
+            count++;
+            pos++;
+        }
+
+        if (pos + 1 >= len || jpeg[pos + 1] != JPEG_MARKER_EOI) {
+            return 0;
+        }
+
+        if (pass == 0) {
+            if (count > layout->interval_capacity) {
+                uint32_t *grown = (uint32_t*)realloc(layout->interval_starts, sizeof(uint32_t) * count);
+                if (!grown) {
+                    return 0;
+                }
+                layout->interval_starts = grown;
+                layout->interval_capacity = count;
+            }
+            layout->interval_starts[0] = (uint32_t)layout->header_end;
+        }
+    }
+    return count;
+}
+
+// Offset of the marker that ends the entropy-coded data starting at pos,
+// or 0 if the data runs past `len`
+static size_t scan_data_end(const uint8_t *jpeg, size_t len, size_t pos) {
+    for (; pos + 1 < len; pos++) {
+        if (jpeg[pos] != 0xFF) continue;
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) continue;   // fill byte
+        if (marker == 0x00 || is_restart_marker(marker)) {
+            pos++;
+            continue;
+        }
+        return pos;
+    }
+    return 0;
+}
+
+// Walks every scan in the first `len` bytes without decoding them. Returns
+// the end of the last scan whose data lies entirely within `len` (0 if
+// none does), and counts the scans and where the base ones end: before the
+// first scan that refines precision or only adds high frequencies.
+static size_t walk_scans(const uint8_t *jpeg, size_t len, int *scan_count,
+                         int *base_scans, size_t *base_end) {
+    size_t complete_end = 0;
+    size_t pos = 2;
+    *scan_count = 0;
+    *base_scans = 0;
+    *base_end = 0;
+
+    while (pos + 4 <= len && jpeg[pos] == 0xFF) {
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker == JPEG_MARKER_EOI) {
+            break;
+        }
+        if (marker == JPEG_MARKER_TEM || is_restart_marker(marker)) {
+            pos += 2;
+            continue;
+        }
+
+        size_t segment_len = ((size_t)jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (marker != JPEG_MARKER_SOS) {
+            pos += 2 + segment_len;
+            continue;
+        }
+
+        // SOS: length, Ns, Ns component selectors, Ss, Se, then Ah:Al
+        size_t components = pos + 4 < len ? jpeg[pos + 4] : 0;
+        size_t spectral_start = pos + 5 + 2 * components;
+        size_t approximation = spectral_start + 2;
+        if (components == 0 || approximation >= len || pos + 2 + segment_len > len) {
+            break;
+        }
+        int refines = (jpeg[approximation] >> 4) > 0 || jpeg[spectral_start] > JPEG_BASE_MAX_START;
+        if (refines && *base_end == 0 && *scan_count > 0) {
+            *base_end = complete_end;
+            *base_scans = *scan_count;
+        }
+        size_t end = scan_data_end(jpeg, len, pos + 2 + segment_len);
+        if (end == 0) {
+            break;
+        }
+        (*scan_count)++;
+        complete_end = end;
+        pos = end;
+    }
+    return complete_end;
+}
+
+size_t jpeg_complete_scans_length(const uint8_t *jpeg, size_t len) {
+    int scan_count, base_scans;
+    size_t base_end;
+    return walk_scans(jpeg, len, &scan_count, &base_scans, &base_end);
+}
+
+// Walks the marker segments up to SOS. Returns the offset of the first byte
+// of scan data, or 0 if SOS is not within the first `len` bytes.
+static size_t parse_header(const uint8_t *jpeg, size_t len, int *baseline, int *progressive,
+                           uint16_t *restart_interval) {
+    if (len < 4 || jpeg[0] != 0xFF || jpeg[1] != JPEG_MARKER_SOI) {
+        return 0;
+    }
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (jpeg[pos] != 0xFF) {
+            return 0;
+        }
+        uint8_t marker = jpeg[pos + 1];
+        if (marker == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (marker == JPEG_MARKER_TEM || is_restart_marker(marker)) {
+            pos += 2;
+            continue;
+        }
+
+        size_t segment_len = ((size_t)jpeg[pos + 2] << 8) | jpeg[pos + 3];
+        if (marker == JPEG_MARKER_SOF0 || marker == JPEG_MARKER_SOF1) {
+            *baseline = 1;
+        } else if (marker == JPEG_MARKER_SOF2) {
+            *progressive = 1;
+        } else if (marker == JPEG_MARKER_DRI && segment_len >= 4 && pos + 6 <= len) {
+            *restart_interval = (uint16_t)((jpeg[pos + 4] << 8) | jpeg[pos + 5]);
+        } else if (marker == JPEG_MARKER_SOS) {
+            size_t header_end = pos + 2 + segment_len;
+            return header_end <= len ? header_end : 0;
+        }
+        pos += 2 + segment_len;
+    }
+    return 0;
+}
+
+size_t jpeg_header_length(const uint8_t *jpeg, size_t len) {
+    int baseline = 0;
+    int progressive = 0;
+    uint16_t restart_interval = 0;
+    return parse_header(jpeg, len, &baseline, &progressive, &restart_interval);
+}
+
+int jpeg_parse_layout(const uint8_t *jpeg, size_t len, jpeg_layout_t *layout) {
+    uint32_t *interval_starts = layout->interval_starts;
+    int interval_capacity = layout->interval_capacity;
+    memset(layout, 0, sizeof(jpeg_layout_t));
+    layout->interval_starts = interval_starts;
+    layout->interval_capacity = interval_capacity;
+    layout->frame_length = len;
+
+    int baseline = 0;
+    int progressive = 0;
+    layout->header_end = parse_header(jpeg, len, &baseline, &progressive, &layout->restart_interval);
+    if (layout->header_end == 0 || layout->header_end >= len) {
+        layout->header_end = 0;
+        return -1;
+    }
+
+    if (baseline && layout->restart_interval > 0) {
+        layout->interval_count = find_restart_intervals(jpeg, len, layout);
+    } else if (progressive) {
+        walk_scans(jpeg, len, &layout->scan_count, &layout->base_scans, &layout->base_end);
+    }
+    return 0;
+}
+
+void free_jpeg_layout(jpeg_layout_t *layout) {
+    free(layout->interval_starts);
+    layout->interval_starts = NULL;
+    layout->interval_count = 0;
+    layout->interval_capacity = 0;
+}
+
+static size_t interval_end(jpeg_layout_t *layout, int k) {
+    return (k + 1 < layout->interval_count) ? layout->interval_starts[k + 1] : layout->frame_length;
+}
+
+static int find_interval(jpeg_layout_t *layout, size_t offset) {
+    int low = 0, high = layout->interval_count - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (layout->interval_starts[mid] <= offset) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+size_t jpeg_next_fragment(jpeg_layout_t *layout, size_t offset, size_t max_len,
+                          jpeg_payload_header_t *header) {
+    size_t remaining = layout->frame_length - offset;
+
+    header->fragment_offset = (uint32_t)offset;
+    header->frame_length = (uint32_t)layout->frame_length;
+    header->restart_count = 0;
+    header->restart_flags = 0;
+
+    // Progressive: no fragment straddles the end of the base scans, so
+    // every packet is either base or refinement as a whole
+    if (layout->base_end > 0) {
+        if (offset >= layout->base_end) {
+            header->type = JPEG_FRAGMENT_REFINE;
+            return remaining < max_len ? remaining : max_len;
+        }
+        size_t base_left = layout->base_end - offset;
+        header->type = JPEG_FRAGMENT_BASE;
+        if (base_left <= max_len) {
+            header->restart_flags = JPEG_BASE_LAST;
+            return base_left;
+        }
+        return max_len;
+    }
+
+    if (layout->interval_count == 0) {
+        header->type = JPEG_FRAGMENT_DATA;
+        return remaining < max_len ? remaining : max_len;
+    }
+
+    if (offset < layout->header_end) {
+        size_t header_left = layout->header_end - offset;
+        header->type = JPEG_FRAGMENT_HEADER;
+        return header_left < max_len ? header_left : max_len;
+    }
+
+    header->type = JPEG_FRAGMENT_SCAN;
+    int k = find_interval(layout, offset);
+    size_t end = interval_end(layout, k);
+    header->restart_count = (uint16_t)k;
+
+    // Tail of an interval that was too large for one packet
+    if (offset != layout->interval_starts[k]) {
+        size_t len = (end - offset < max_len) ? end - offset : max_len;
+        header->restart_flags = (offset + len == end) ? JPEG_RESTART_LAST : 0;
+        return len;
+    }
+
+    if (end - offset > max_len) {
+        header->restart_flags = JPEG_RESTART_FIRST;
+        return max_len;
+    }
+
+    // Pack as many whole intervals as fit
+    int last = k;
+    while (last + 1 < layout->interval_count && interval_end(layout, last + 1) - offset <= max_len) {
+        last++;
+    }
+    header->restart_flags = JPEG_RESTART_FIRST | JPEG_RESTART_LAST;
+    return interval_end(layout, last) - offset;
+}
+
+int create_jpeg_packet(rtp_packet_t *packet, uint16_t seq, uint32_t timestamp, uint32_t ssrc,
+                       jpeg_payload_header_t *header, uint8_t *data, size_t data_len) {
+    if (data_len + sizeof(jpeg_payload_header_t) > MAX_PAYLOAD_SIZE) {
+        fprintf(stderr, "Error: Payload size exceeds maximum\n");
+        return -1;
+    }
+
+    init_rtp_header(&packet->header, seq, timestamp, ssrc);
+
+    jpeg_payload_header_t wire;
+    wire.fragment_offset = htonl(header->fragment_offset);
+    wire.frame_length = htonl(header->frame_length);
+    wire.restart_count = htons(header->restart_count);
+    wire.restart_flags = header->restart_flags;
+    wire.type = header->type;
+    memcpy(packet->payload, &wire, sizeof(wire));
+    memcpy(packet->payload + sizeof(wire), data, data_len);
+
+    return sizeof(rtp_header_t) + sizeof(wire) + data_len;
+}
+
+int parse_jpeg_payload(uint8_t *payload, size_t payload_size, jpeg_payload_header_t *header,
+                       uint8_t **data, size_t *data_len) {
+    if (payload_size < sizeof(jpeg_payload_header_t)) {
+        return -1;
+    }
+
+    memcpy(header, payload, sizeof(jpeg_payload_header_t));
+    header->fragment_offset = ntohl(header->fragment_offset);
+    header->frame_length = ntohl(header->frame_length);
+    header->restart_count = ntohs(header->restart_count);
+
+    *data = payload + sizeof(jpeg_payload_header_t);
+    *data_len = payload_size - sizeof(jpeg_payload_header_t);
+    return 0;
+}
+
+size_t write_jpeg_reference(uint8_t *out, uint64_t reference_hash, uint32_t delta_length) {
+    uint32_t words[3];
+    words[0] = htonl((uint32_t)(reference_hash >> 32));
+    words[1] = htonl((uint32_t)reference_hash);
+    words[2] = htonl(delta_length);
+    memcpy(out, words, sizeof(jpeg_reference_t));
+    return sizeof(jpeg_reference_t);
+}
+
+int parse_jpeg_reference(uint8_t **data, size_t *data_len, jpeg_reference_t *reference) {
+    if (*data_len < sizeof(jpeg_reference_t)) {
+        return -1;
+    }
+
+    uint32_t words[3];
+    memcpy(words, *data, sizeof(jpeg_reference_t));
+    reference->reference_hash = ((uint64_t)ntohl(words[0]) << 32) | ntohl(words[1]);
+    reference->delta_length = ntohl(words[2]);
+
+    *data += sizeof(jpeg_reference_t);
+    *data_len -= sizeof(jpeg_reference_t);
+    return 0;
+}
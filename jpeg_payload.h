@@ -0,0 +1,103 @@
+#ifndef JPEG_PAYLOAD_H
+#define JPEG_PAYLOAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rtp.h"
+
+// RFC 2435-style payload header carried in front of every JPEG fragment.
+// Unlike RFC 2435 the JPEG headers travel in-band as their own fragments,
+// but fragment offsets and the restart marker fields follow its layout so
+// packets of a restart-interval frame start and end on interval boundaries
+// and a receiver can replace a lost interval without the rest of the scan.
+typedef struct {
+    uint32_t fragment_offset;   // byte offset of this fragment within the frame
+    uint32_t frame_length;      // size of the complete frame in bytes
+    uint16_t restart_count;     // index of the first restart interval in the fragment
+    uint8_t restart_flags;      // JPEG_RESTART_FIRST / JPEG_RESTART_LAST
+    uint8_t type;               // JPEG_FRAGMENT_*
+} __attribute__((packed)) jpeg_payload_header_t;
+
+#define JPEG_FRAGMENT_HEADER 0  // JPEG headers up to the start of scan data
+#define JPEG_FRAGMENT_SCAN 1    // scan data aligned to restart intervals
+#define JPEG_FRAGMENT_DATA 2    // unaligned bytes (no DRI, or progressive)
+#define JPEG_FRAGMENT_REPEAT 3  // frame identical to an acknowledged reference, no data
+#define JPEG_FRAGMENT_DELTA 4   // changed bytes to apply on top of an acknowledged reference
+#define JPEG_FRAGMENT_BASE 5    // progressive: headers and base scans
+#define JPEG_FRAGMENT_REFINE 6  // progressive: refinement scans and what follows them
+
+// Prefix on REPEAT and DELTA fragment data naming the reference frame (by
+// frame_hash) the client rebuilds from, and how many bytes the sender
+// changed in total so the client can tell when a delta frame is complete
+typedef struct {
+    uint64_t reference_hash;
+    uint32_t delta_length;
+} __attribute__((packed)) jpeg_reference_t;
+
+#define JPEG_RESTART_FIRST 0x1  // fragment begins an interval
+#define JPEG_RESTART_LAST 0x2   // fragment ends an interval
+#define JPEG_BASE_LAST 0x4      // BASE fragment that ends the base scans
+
+#define JPEG_MARKER_SOI 0xD8
+#define JPEG_MARKER_EOI 0xD9
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_DRI 0xDD
+#define JPEG_MARKER_RST0 0xD0
+#define JPEG_MARKER_RST7 0xD7
+
+// Where the restart intervals of a single-scan JPEG sit. interval_count is
+// 0 when the image has no DRI or is not a single baseline scan, in which
+// case it is carried as plain JPEG_FRAGMENT_DATA.
+//
+// For a progressive JPEG, base_end is where its base scans end: the leading
+// first-pass scans of DC and low-frequency AC, up to the first scan that
+// refines precision (Ah > 0) or only adds high frequencies. Those alone
+// decode to a low-detail image, so they are sent as JPEG_FRAGMENT_BASE and
+// the rest as JPEG_FRAGMENT_REFINE. base_end is 0 for baseline images and
+// for progressive ones where every scan would count as base.
+typedef struct {
+    size_t header_end;          // first byte of entropy-coded data
+    size_t frame_length;
+    uint32_t *interval_starts;  // interval k spans [starts[k], starts[k+1]), last ends at frame_length
+    int interval_count;
+    int interval_capacity;      // kept across parses, so re-parsing rarely allocates
+    uint16_t restart_interval;  // MCUs per interval from the DRI marker
+    size_t base_end;            // progressive: end of the last base scan's data
+    int scan_count;             // progressive: scans in the image
+    int base_scans;
+} jpeg_layout_t;
+
+// The layout must be zeroed or previously parsed; its interval storage is reused
+int jpeg_parse_layout(const uint8_t *jpeg, size_t len, jpeg_layout_t *layout);
+void free_jpeg_layout(jpeg_layout_t *layout);
+
+// Offset of the first byte of scan data if the headers up to and including
+// SOS lie within the first `len` bytes, 0 otherwise
+size_t jpeg_header_length(const uint8_t *jpeg, size_t len);
+
+// Length of the longest prefix of the first `len` bytes that ends right
+// after a complete scan, 0 if no scan is complete. Appending EOI to it
+// gives a decodable progressive JPEG.
+size_t jpeg_complete_scans_length(const uint8_t *jpeg, size_t len);
+
+// Picks the fragment that starts at `offset`, no larger than max_len, and
+// fills in its payload header (host byte order). Returns the fragment size.
+size_t jpeg_next_fragment(jpeg_layout_t *layout, size_t offset, size_t max_len,
+                          jpeg_payload_header_t *header);
+
+int create_jpeg_packet(rtp_packet_t *packet, uint16_t seq, uint32_t timestamp, uint32_t ssrc,
+                       jpeg_payload_header_t *header, uint8_t *data, size_t data_len);
+
+// Splits a received payload into header (converted to host order) and data.
+// Returns -1 if the payload is too short to carry a header.
+int parse_jpeg_payload(uint8_t *payload, size_t payload_size, jpeg_payload_header_t *header,
+                       uint8_t **data, size_t *data_len);
+
+// Writes a jpeg_reference_t in network byte order, returns its size
+size_t write_jpeg_reference(uint8_t *out, uint64_t reference_hash, uint32_t delta_length);
+
+// Strips the reference prefix off REPEAT/DELTA fragment data.
+// Returns -1 if the data is too short to carry one.
+int parse_jpeg_reference(uint8_t **data, size_t *data_len, jpeg_reference_t *reference);
+
+#endif // JPEG_PAYLOAD_H
@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "rtp.h"
+#include "time_utils.h"
+
+// UDP relay that sits between server and client and applies the same
+// impairments mininet_test.py configures on its TCLink: loss, delay,
+// bandwidth and reordering. Decisions come from a seeded PRNG so a given
+// scenario drops and reorders the same packets on every run.
+
+#define EMU_QUEUE_LIMIT 1000 // netem's default queue limit
+
+typedef struct {
+    uint64_t release_us;
+    uint64_t order;       // tie-break so equal release times stay FIFO
+    int to_client;
+    size_t len;
+    uint8_t *data;
+} queued_packet_t;
+
+typedef struct {
+    uint64_t link_free_us; // when the serializer finishes the previous packet
+    uint32_t forwarded;
+    uint32_t dropped;
+    uint32_t reordered;
+    uint32_t too_big;
+    uint64_t bytes;
+} link_direction_t;
+
+typedef struct {
+    double loss_pct;
+    long delay_ms;
+    double bw_mbps;
+    double reorder_pct;
+    long mtu;              // datagrams over mtu - IP/UDP headers are dropped, 0 for none
+} link_config_t;
+
+static queued_packet_t queue[EMU_QUEUE_LIMIT];
+static int queue_len = 0;
+static uint64_t queue_order = 0;
+static volatile sig_atomic_t running = 1;
+static uint64_t rng_state;
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static uint64_t now_us(void) {
+    struct timeval tv;
+    get_monotonic_time(&tv);
+    return (uint64_t)tv.tv_sec * 1000000ULL + (uint64_t)tv.tv_usec;
+}
+
+static double next_uniform(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double)((rng_state * 2685821657736338717ULL) >> 11) / 9007199254740992.0;
+}
+
+static int queued_before(queued_packet_t *a, queued_packet_t *b) {
+    if (a->release_us != b->release_us) return a->release_us < b->release_us;
+    return a->order < b->order;
+}
+
+static void queue_push(queued_packet_t *packet) {
+    int i = queue_len++;
+    queue[i] = *packet;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!queued_before(&queue[i], &queue[parent])) break;
+        queued_packet_t tmp = queue[i];
+        queue[i] = queue[parent];
+        queue[parent] = tmp;
+        i = parent;
+    }
+}
+
+static void queue_pop(queued_packet_t *out) {
+    *out = queue[0];
+    queue[0] = queue[--queue_len];
+    int i = 0;
+    while (1) {
+        int left = 2 * i + 1, right = left + 1, smallest = i;
+        if (left < queue_len && queued_before(&queue[left], &queue[smallest])) smallest = left;
+        if (right < queue_len && queued_before(&queue[right], &queue[smallest])) smallest = right;
+        if (smallest == i) break;
+        queued_packet_t tmp = queue[i];
+        queue[i] = queue[smallest];
+        queue[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+// Returns 1 if the packet was queued, 0 if the link dropped it
+static int enqueue(link_config_t *config, link_direction_t *dir, int to_client,
+                   uint8_t *data, size_t len, uint64_t now) {
+    // Like a router with DF set: no fragmentation, the datagram is just lost
+    if (config->mtu > 0 && len + IP_UDP_OVERHEAD > (size_t)config->mtu) {
+        dir->too_big++;
+        return 0;
+    }
+
+    if (next_uniform() * 100.0 < config->loss_pct || queue_len >= EMU_QUEUE_LIMIT) {
+        dir->dropped++;
+        return 0;
+    }
+
+    uint64_t tx_us = (uint64_t)((len * 8.0) / config->bw_mbps);
+    uint64_t depart = (dir->link_free_us > now ? dir->link_free_us : now) + tx_us;
+    dir->link_free_us = depart;
+
+    // Like netem, a reordered packet skips the delay line and overtakes
+    // whatever is still in flight, so reordering needs a non-zero delay
+    uint64_t release = depart + (uint64_t)config->delay_ms * 1000;
+    if (config->delay_ms > 0 && next_uniform() * 100.0 < config->reorder_pct) {
+        release = depart;
+        dir->reordered++;
+    }
+
+    queued_packet_t packet;
+    packet.release_us = release;
+    packet.order = queue_order++;
+    packet.to_client = to_client;
+    packet.len = len;
+    packet.data = (uint8_t*)malloc(len);
+    if (!packet.data) {
+        dir->dropped++;
+        return 0;
+    }
+    memcpy(packet.data, data, len);
+    queue_push(&packet);
+    return 1;
+}
+
+static void print_direction(const char *name, link_direction_t *dir) {
+    printf("%s: forwarded %u, dropped %u, reordered %u, over MTU %u, bytes %llu\n",
+           name, dir->forwarded, dir->dropped, dir->reordered, dir->too_big,
+           (unsigned long long)dir->bytes);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4 || argc > 10) {
+        fprintf(stderr, "Usage: %s <listen_port> <client_ip> <client_port> "
+                        "[loss_pct] [delay_ms] [bw_mbps] [reorder_pct] [seed] [mtu]\n", argv[0]);
+        return 1;
+    }
+
+    int listen_port = atoi(argv[1]);
+    link_config_t config;
+    config.loss_pct = (argc > 4) ? atof(argv[4]) : 0.0;
+    config.delay_ms = (argc > 5) ? atol(argv[5]) : 0;
+    config.bw_mbps = (argc > 6) ? atof(argv[6]) : 10.0;
+    config.reorder_pct = (argc > 7) ? atof(argv[7]) : 0.0;
+    rng_state = (argc > 8) ? strtoull(argv[8], NULL, 0) : 1;
+    config.mtu = (argc > 9) ? atol(argv[9]) : 0;
+    if (rng_state == 0) rng_state = 1;
+    if (config.bw_mbps <= 0) {
+        fprintf(stderr, "Bandwidth must be positive\n");
+        return 1;
+    }
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0) {
+        perror("Socket creation failed");
+        return 1;
+    }
+
+    struct sockaddr_in listen_addr;
+    memset(&listen_addr, 0, sizeof(listen_addr));
+    listen_addr.sin_family = AF_INET;
+    listen_addr.sin_port = htons(listen_port);
+    listen_addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(sockfd, (struct sockaddr*)&listen_addr, sizeof(listen_addr)) < 0) {
+        perror("Bind failed");
+        close(sockfd);
+        return 1;
+    }
+
+    struct sockaddr_in client_addr;
+    memset(&client_addr, 0, sizeof(client_addr));
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_port = htons(atoi(argv[3]));
+    client_addr.sin_addr.s_addr = inet_addr(argv[2]);
+
+    struct sockaddr_in server_addr;
+    int have_server = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Link emulator on port %d -> %s:%s (loss %.1f%%, delay %ldms, bw %.1fMbps, reorder %.1f%%, mtu %ld)\n",
+           listen_port, argv[2], argv[3], config.loss_pct, config.delay_ms,
+           config.bw_mbps, config.reorder_pct, config.mtu);
+
+    link_direction_t downlink, uplink;
+    memset(&downlink, 0, sizeof(downlink));
+    memset(&uplink, 0, sizeof(uplink));
+    static uint8_t buffer[MAX_PACKET_SIZE];
+
+    while (running) {
+        uint64_t now = now_us();
+
+        while (queue_len > 0 && queue[0].release_us <= now) {
+            queued_packet_t packet;
+            queue_pop(&packet);
+            if (packet.to_client) {
+                sendto(sockfd, packet.data, packet.len, 0,
+                       (struct sockaddr*)&client_addr, sizeof(client_addr));
+                downlink.forwarded++;
+                downlink.bytes += packet.len;
+            } else if (have_server) {
+                sendto(sockfd, packet.data, packet.len, 0,
+                       (struct sockaddr*)&server_addr, sizeof(server_addr));
+                uplink.forwarded++;
+                uplink.bytes += packet.len;
+            }
+            free(packet.data);
+        }
+
+        int timeout_ms = 100;
+        if (queue_len > 0) {
+            uint64_t wait_us = queue[0].release_us - now;
+            timeout_ms = (int)(wait_us / 1000);
+        }
+
+        struct pollfd pfd;
+        pfd.fd = sockfd;
+        pfd.events = POLLIN;
+        int ready = poll(&pfd, 1, timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            perror("poll failed");
+            break;
+        }
+        if (ready == 0) continue;
+
+        struct sockaddr_in from_addr;
+        socklen_t from_len = sizeof(from_addr);
+        ssize_t len = recvfrom(sockfd, buffer, sizeof(buffer), 0,
+                               (struct sockaddr*)&from_addr, &from_len);
+        if (len <= 0) continue;
+
+        int from_client = from_addr.sin_addr.s_addr == client_addr.sin_addr.s_addr &&
+                          from_addr.sin_port == client_addr.sin_port;
+        if (from_client) {
+            enqueue(&config, &uplink, 0, buffer, (size_t)len, now_us());
+        } else {
+            server_addr = from_addr;
+            have_server = 1;
+            enqueue(&config, &downlink, 1, buffer, (size_t)len, now_us());
+        }
+    }
+
+    printf("\n=== Link Emulator ===\n");
+    print_direction("Server -> client", &downlink);
+    print_direction("Client -> server", &uplink);
+    printf("=====================\n");
+
+    while (queue_len > 0) {
+        queued_packet_t packet;
+        queue_pop(&packet);
+        free(packet.data);
+    }
+    close(sockfd);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#!/bin/sh
+# End-to-end scenarios over the in-process link emulator instead of Mininet.
+# Runs the real server and client on loopback with link_emulator relaying
+# between them, then prints one CSV row per scenario.
+#
+# Usage: ./link_test.sh [image_file] [duration_sec] [seed]
+
+IMAGE_FILE=${1:-test_image.jpg}
+DURATION=${2:-10}
+SEED=${3:-42}
+CLIENT_PORT=15004
+EMULATOR_PORT=15005
+LOG_DIR=link_test_logs
+
+if [ ! -f "$IMAGE_FILE" ]; then
+    echo "Image $IMAGE_FILE not found (see README for how to fetch one)" >&2
+    exit 1
+fi
+
+mkdir -p frames "$LOG_DIR"
+
+# name loss_pct delay_ms bw_mbps reorder_pct (same knobs as mininet_test.py)
+# mtu (0 for no limit, so the server negotiates loopback-sized datagrams)
+SCENARIOS="
+clean 0 0 10 0 0
+lossy 5 10 10 0 0
+reorder 0 10 10 25 0
+constrained 1 20 2 0 0
+ethernet 0 0 10 0 1500
+"
+
+stat_value() {
+    # Last occurrence wins: the client prints its final stats on exit
+    grep "^$2:" "$1" | tail -n 1 | sed 's/^[^:]*: *//; s/ .*//'
+}
+
+echo "scenario,loss_pct,delay_ms,bw_mbps,reorder_pct,mtu,datagram_bytes,frames,fps,kbps,packets_lost,retransmit_requests,nack_retries,packets_recovered,avg_frame_latency_ms,max_frame_latency_ms"
+
+echo "$SCENARIOS" | while read -r name loss delay bw reorder mtu; do
+    [ -z "$name" ] && continue
+    client_log="$LOG_DIR/${name}_client.log"
+    rm -f frames/received_frame_*.jpg
+
+    ./client $CLIENT_PORT > "$client_log" 2>&1 &
+    client_pid=$!
+    ./link_emulator $EMULATOR_PORT 127.0.0.1 $CLIENT_PORT $loss $delay $bw $reorder $SEED $mtu \
+        > "$LOG_DIR/${name}_emulator.log" 2>&1 &
+    emulator_pid=$!
+    sleep 0.5
+
+    ./server 127.0.0.1 $EMULATOR_PORT "$IMAGE_FILE" > "$LOG_DIR/${name}_server.log" 2>&1 &
+    server_pid=$!
+    sleep "$DURATION"
+
+    kill $server_pid 2>/dev/null
+    wait $server_pid 2>/dev/null
+    sleep 1
+    kill -INT $client_pid $emulator_pid 2>/dev/null
+    wait $client_pid $emulator_pid 2>/dev/null
+
+    echo "$name,$loss,$delay,$bw,$reorder,$mtu,$(stat_value "$client_log" 'Largest datagram'),$(stat_value "$client_log" 'Frames received'),$(stat_value "$client_log" 'Average frame rate'),$(stat_value "$client_log" 'Average bitrate'),$(stat_value "$client_log" 'Packets lost'),$(stat_value "$client_log" 'Retransmit requests'),$(stat_value "$client_log" 'NACK retries'),$(stat_value "$client_log" 'Packets recovered'),$(stat_value "$client_log" 'Average frame latency'),$(stat_value "$client_log" 'Max frame latency')"
+done
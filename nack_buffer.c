@@ -2,24 +2,73 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
-#include <math.h>
+#include <inttypes.h>
 #include "nack_buffer.h"
 #include "time_utils.h"
 #include "rtp.h"
+#include "buffer_config.h"
 
 
-void init_nack_buffer(nack_buffer_t *nb) {
+int init_nack_buffer(nack_buffer_t *nb, int capacity) {
+    memset(nb, 0, sizeof(nack_buffer_t));
+    if (capacity < NACK_BUFFER_SIZE) capacity = NACK_BUFFER_SIZE;
 
-    memset(nb->entries, 0, sizeof(nb->entries));
+    nb->entries = (nack_entry_t*)calloc(capacity, sizeof(nack_entry_t));
+    if (!nb->entries) {
+        fprintf(stderr, "Error: Failed to allocate NACK buffer of %d entries\n", capacity);
+        return -1;
+    }
+    nb->capacity = capacity;
+    return 0;
+}
+
+void free_nack_buffer(nack_buffer_t *nb) {
+    free(nb->entries);
+    nb->entries = NULL;
+    nb->capacity = 0;
+}
+
+void reset_nack_buffer(nack_buffer_t *nb) {
+    memset(nb->entries, 0, sizeof(nack_entry_t) * nb->capacity);
+}
+
+static size_t get_index(nack_buffer_t *nb, uint64_t seq) {
+    return seq % nb->capacity;
 }
 
-static size_t get_index(uint16_t seq) {
-    return seq % NACK_BUFFER_SIZE;
+static int grow(nack_buffer_t *nb) {
+    size_t capacity = buffer_grow_capacity(nb->capacity, nb->capacity + 1, BUFFER_MAX_PACKETS);
+    if (capacity <= (size_t)nb->capacity) {
+        return -1;
+    }
+
+    // A heap allocation, but a rare one: only after sustained overflow
+    nack_entry_t *grown = (nack_entry_t*)calloc(capacity, sizeof(nack_entry_t));
+    if (!grown) {
+        return -1;
+    }
+    // Entries apart by a multiple of the new capacity would share a slot,
+    // which happens once the cap stops it being a multiple of the old one
+    for (int i = 0; i < nb->capacity; i++) {
+        if (nb->entries[i].retry_count == 0) continue;
+        nack_entry_t *slot = &grown[nb->entries[i].seq % capacity];
+        if (slot->retry_count > 0) {
+            free(grown);
+            return -1;
+        }
+        *slot = nb->entries[i];
+    }
+    free(nb->entries);
+    nb->entries = grown;
+    nb->capacity = (int)capacity;
+    nb->resizes++;
+    printf("NACK buffer grown to %d entries\n", nb->capacity);
+    return 0;
 }
 
 
-static nack_entry_t* get_entry(nack_buffer_t *nb, uint16_t seq) {
-    size_t index = get_index(seq);
+static nack_entry_t* get_entry(nack_buffer_t *nb, uint64_t seq) {
+    size_t index = get_index(nb, seq);
     nack_entry_t *entry = &nb->entries[index];
     if (entry->seq == seq && entry->retry_count > 0) {
         return entry;
@@ -28,15 +77,21 @@ static nack_entry_t* get_entry(nack_buffer_t *nb, uint16_t seq) {
     return entry;
 }
 
+// A retransmission answering the last NACK would have arrived by now, so
+// asking again is worthwhile
 static long calculate_min_wait_ms(uint8_t retry_count) {
     if (retry_count == 0) {
         return 0; 
     }
     
-    return (long)pow((double)RTT_MS, (double)retry_count);
+    return RTT_MS;
 }
 
-int can_send_nack(nack_buffer_t *nb, uint16_t seq) {
+long nack_time_left_ms(struct timeval *deadline, struct timeval *now) {
+    return time_diff_ms(now, deadline) - RTT_MS;
+}
+
+int can_send_nack(nack_buffer_t *nb, uint64_t seq) {
     nack_entry_t *entry = get_entry(nb, seq);
     
     if (entry->seq != seq || entry->retry_count == 0) {
@@ -51,11 +106,15 @@ int can_send_nack(nack_buffer_t *nb, uint16_t seq) {
     struct timeval now;
     get_monotonic_time(&now);
 
+    if (nack_time_left_ms(&entry->deadline, &now) < 0) {
+        return 0;
+    }
+
     long required_wait_ms = calculate_min_wait_ms(entry->retry_count);
     long time_since_last_nack_ms = time_diff_ms(&entry->last_nack_time, &now);
     
     if (time_since_last_nack_ms >= required_wait_ms) {
-        printf("Time passed (seq=%u, count=%u). Sent: %ldms, Required: %ldms. Sending NACK.\n", 
+        printf("Time passed (seq=%" PRIu64 ", count=%u). Sent: %ldms, Required: %ldms. Sending NACK.\n", 
                  seq, entry->retry_count, time_since_last_nack_ms, required_wait_ms);
         return 1;
     } else {
@@ -65,13 +124,19 @@ int can_send_nack(nack_buffer_t *nb, uint16_t seq) {
     }
 }
 
-void record_nack_attempt(nack_buffer_t *nb, uint16_t seq) {
+void record_nack_attempt(nack_buffer_t *nb, uint64_t seq, struct timeval *deadline) {
     nack_entry_t *entry = get_entry(nb, seq);
+    if (entry->seq != seq && entry->retry_count > 0 && buffer_overflow_sustained(&nb->overflow)) {
+        while (entry->seq != seq && entry->retry_count > 0 && grow(nb) == 0) {
+            entry = get_entry(nb, seq);
+        }
+    }
 
 
     if (entry->seq != seq || entry->retry_count == 0) {
         entry->seq = seq;
         entry->retry_count = 1;
+        entry->deadline = *deadline;
     } else {
      
         entry->retry_count++;
@@ -80,38 +145,58 @@ void record_nack_attempt(nack_buffer_t *nb, uint16_t seq) {
     get_monotonic_time(&entry->last_nack_time);
 }
 
-void clear_nack_entry(nack_buffer_t *nb, uint16_t seq) {
+// Returns 1 if seq had an outstanding NACK, i.e. the packet was recovered
+int clear_nack_entry(nack_buffer_t *nb, uint64_t seq) {
     nack_entry_t *entry = get_entry(nb, seq);
 
     if (entry->seq == seq) {
+        int was_pending = entry->retry_count > 0;
         entry->seq = 0;
         entry->retry_count = 0;
         entry->last_nack_time.tv_sec = 0;
         entry->last_nack_time.tv_usec = 0;
+        return was_pending;
     }
+    return 0;
 }
 
-void manage_nack_timeouts(nack_buffer_t *nb, int sockfd, struct sockaddr_in *server_addr) {
+void manage_nack_timeouts(nack_buffer_t *nb, transport_t *transport, stats_t *stats) {
     struct timeval now;
     get_monotonic_time(&now);
 
-    for (int i = 0; i < NACK_BUFFER_SIZE; i++) {
+    for (int i = 0; i < nb->capacity; i++) {
         nack_entry_t *entry = &nb->entries[i];
         if (entry->retry_count == 0) continue;
-        if (entry->retry_count >= NACK_MAX_RETRIES) {
+
+        // Kept until the deadline itself, so an answer to the last NACK
+        // still counts as a recovery
+        if (time_diff_ms(&now, &entry->deadline) < 0) {
             entry->seq = 0;
             entry->retry_count = 0;
             continue;
         }
+        if (entry->retry_count >= NACK_MAX_RETRIES) continue;
 
         long required_wait_ms = calculate_min_wait_ms(entry->retry_count);
         long elapsed = time_diff_ms(&entry->last_nack_time, &now);
+        if (elapsed < required_wait_ms) continue;
+
+        long time_left_ms = nack_time_left_ms(&entry->deadline, &now);
+        if (time_left_ms < 0) {
+            printf("NACK for seq=%" PRIu64 " abandoned: a retransmission would miss playout\n", entry->seq);
+            entry->retry_count = NACK_MAX_RETRIES;
+            if (stats != NULL) {
+                stats->nacks_suppressed++;
+            }
+            continue;
+        }
 
-        if (elapsed >= required_wait_ms) {
-            printf("NACK Timeout for seq=%u. Retrying (%d/%d)...\n", entry->seq, entry->retry_count + 1, NACK_MAX_RETRIES);
-            send_nack(sockfd, server_addr, entry->seq);
-            entry->retry_count++;
-            entry->last_nack_time = now;
+        printf("NACK Timeout for seq=%" PRIu64 ". Retrying (%d/%d)...\n", entry->seq, entry->retry_count + 1, NACK_MAX_RETRIES);
+        send_nack(transport, (uint16_t)entry->seq, time_left_ms + RTT_MS);
+        entry->retry_count++;
+        entry->last_nack_time = now;
+        if (stats != NULL) {
+            stats->nack_retries++;
         }
     }
 }
\ No newline at end of file
@@ -4,26 +4,48 @@
 #include <stdint.h>
 #include <sys/time.h>
 #include <string.h>
+#include "rtp.h"
+#include "stats.h"
+#include "buffer_config.h"
 
-#define NACK_BUFFER_SIZE 256
+#define NACK_BUFFER_SIZE 256     // minimum capacity, see buffer_config.h
 #define NACK_MAX_RETRIES 3
-#define RTT_MS 13
 
 typedef struct {
-    uint16_t seq;          
+    uint64_t seq;           // extended sequence number
     uint8_t retry_count;    
     struct timeval last_nack_time; 
+    struct timeval deadline;  // playout deadline, a retransmission arriving later is useless
 } nack_entry_t;
 
+// Entries live at seq % capacity
 typedef struct {
-    nack_entry_t entries[NACK_BUFFER_SIZE];
+    nack_entry_t *entries;
+    int capacity;
+    int resizes;
+    buffer_overflow_t overflow; // when to grow rather than drop
 } nack_buffer_t;
 
 
-void init_nack_buffer(nack_buffer_t *nb);
-int can_send_nack(nack_buffer_t *nb, uint16_t seq);
-void record_nack_attempt(nack_buffer_t *nb, uint16_t seq);
-void clear_nack_entry(nack_buffer_t *nb, uint16_t seq);
-void manage_nack_timeouts(nack_buffer_t *nb, int sockfd, struct sockaddr_in *server_addr);
+int init_nack_buffer(nack_buffer_t *nb, int capacity);
+void free_nack_buffer(nack_buffer_t *nb);
+
+// Forgets every outstanding NACK, keeping the capacity
+void reset_nack_buffer(nack_buffer_t *nb);
+int can_send_nack(nack_buffer_t *nb, uint64_t seq);
+// Overwrites a different NACK still outstanding in the same slot, unless
+// that keeps happening: then the buffer doubles (up to BUFFER_MAX_PACKETS)
+void record_nack_attempt(nack_buffer_t *nb, uint64_t seq, struct timeval *deadline);
+int clear_nack_entry(nack_buffer_t *nb, uint64_t seq);
+
+// Asks again for packets a retransmission should have answered by now (one
+// RTT after the last NACK), while one could still beat the deadline. Counts
+// the retries in stats->nack_retries and the NACKs abandoned at the
+// deadline in stats->nacks_suppressed (stats may be NULL).
+void manage_nack_timeouts(nack_buffer_t *nb, transport_t *transport, stats_t *stats);
+
+// Milliseconds left before the deadline once a retransmission would arrive,
+// negative when asking again is pointless
+long nack_time_left_ms(struct timeval *deadline, struct timeval *now);
 
 #endif // NACK_BUFFER_H
\ No newline at end of file
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include "playout_buffer.h"
+#include "buffer_config.h"
+#include "time_utils.h"
+
+static void add_ms(struct timeval *tv, const struct timeval *from, long ms) {
+    *tv = *from;
+    tv->tv_usec += ms * 1000L;
+    tv->tv_sec += tv->tv_usec / 1000000L;
+    tv->tv_usec %= 1000000L;
+}
+
+static int before(const struct timeval *a, const struct timeval *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_usec < b->tv_usec);
+}
+
+int init_playout_buffer(playout_buffer_t *pb, int capacity, size_t slot_size, arena_t *arena) {
+    memset(pb, 0, sizeof(playout_buffer_t));
+    if (capacity < PLAYOUT_BUFFER_SIZE) capacity = PLAYOUT_BUFFER_SIZE;
+
+    pb->slots = (playout_slot_t*)calloc(capacity, sizeof(playout_slot_t));
+    if (!pb->slots) {
+        fprintf(stderr, "Error: Failed to allocate playout buffer of %d packets\n", capacity);
+        return -1;
+    }
+    pb->capacity = capacity;
+    pb->arena = arena;
+    pb->slot_size = slot_size > 0 ? slot_size : PLAYOUT_SLOT_SIZE;
+    return 0;
+}
+
+void free_playout_buffer(playout_buffer_t *pb) {
+    for (int i = 0; i < pb->capacity; i++) {
+        arena_release(pb->arena, pb->slots[i].packet);
+    }
+    free(pb->slots);
+    pb->slots = NULL;
+    pb->capacity = 0;
+    pb->count = 0;
+}
+
+void reset_playout_buffer(playout_buffer_t *pb) {
+    for (int i = 0; i < pb->capacity; i++) {
+        pb->slots[i].state = PLAYOUT_EMPTY;
+    }
+    pb->initialized = 0;
+    pb->count = 0;
+}
+
+// Re-homes every held or missing slot at seq % new capacity, reusing the
+// old slot allocations for the rest
+static int grow(playout_buffer_t *pb, size_t needed) {
+    size_t capacity = buffer_grow_capacity(pb->capacity, needed, BUFFER_MAX_PACKETS);
+    if (capacity < needed) {
+        return -1;
+    }
+
+    // Slot table on the heap, so the outgrown one can be freed; only the
+    // packet data lives in the arena
+    playout_slot_t *grown = (playout_slot_t*)calloc(capacity, sizeof(playout_slot_t));
+    if (!grown) {
+        return -1;
+    }
+    for (int i = 0; i < pb->capacity; i++) {
+        if (pb->slots[i].state != PLAYOUT_EMPTY) {
+            grown[pb->slots[i].seq % capacity] = pb->slots[i];
+        }
+    }
+    size_t spare = 0;
+    for (int i = 0; i < pb->capacity; i++) {
+        if (pb->slots[i].state != PLAYOUT_EMPTY || !pb->slots[i].packet) continue;
+        while (grown[spare].state != PLAYOUT_EMPTY || grown[spare].packet) spare++;
+        grown[spare].packet = pb->slots[i].packet;
+        grown[spare].slot_capacity = pb->slots[i].slot_capacity;
+        spare++;
+    }
+
+    free(pb->slots);
+    pb->slots = grown;
+    pb->capacity = (int)capacity;
+    pb->resizes++;
+    printf("Playout buffer window grown to %d packets\n", pb->capacity);
+    return 0;
+}
+
+int playout_buffer_insert(playout_buffer_t *pb, uint64_t seq, rtp_packet_t *packet, size_t size,
+                          const struct timeval *gap_deadline) {
+    if (!pb->initialized) {
+        pb->next_seq = seq;
+        pb->highest_seq = seq;
+        pb->initialized = 1;
+    }
+    if (seq < pb->next_seq) {
+        return PLAYOUT_STALE;
+    }
+
+    uint64_t offset = seq - pb->next_seq;
+    if (offset >= (uint64_t)pb->capacity &&
+        (!buffer_overflow_sustained(&pb->overflow) || grow(pb, (size_t)offset + 1) < 0)) {
+        printf("Warning: Packet too far ahead of playout (seq=%" PRIu64 ", next=%" PRIu64 ")\n",
+               seq, pb->next_seq);
+        return -1;
+    }
+
+    playout_slot_t *slot = &pb->slots[seq % pb->capacity];
+    if (slot->state == PLAYOUT_PRESENT) {
+        return PLAYOUT_STALE;
+    }
+
+    // Slots follow the negotiated datagram size, carved at the largest seen
+    if (size > slot->slot_capacity) {
+        if (size > pb->slot_size) pb->slot_size = size;
+        rtp_packet_t *grown = (rtp_packet_t*)arena_realloc(pb->arena, slot->packet, 0, pb->slot_size);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to grow playout buffer slot to %zu bytes\n", size);
+            return -1;
+        }
+        slot->packet = grown;
+        slot->slot_capacity = pb->slot_size;
+    }
+
+    struct timeval now;
+    get_monotonic_time(&now);
+
+    // Everything skipped over is missing from now on; one deadline covers
+    // waiting for reordering and for retransmissions
+    if (seq > pb->highest_seq + 1) {
+        for (uint64_t missing = pb->highest_seq + 1; missing < seq; missing++) {
+            playout_slot_t *gap = &pb->slots[missing % pb->capacity];
+            gap->seq = missing;
+            gap->deadline = *gap_deadline;
+            gap->state = PLAYOUT_MISSING;
+        }
+    }
+
+    // A packet that fills a gap is already late and holds back the ones
+    // after it, so it is due at once
+    int result = PLAYOUT_IN_ORDER;
+    if (slot->state == PLAYOUT_MISSING) {
+        result = PLAYOUT_REORDERED;
+        slot->deadline = now;
+        printf("Buffered out-of-order packet: seq=%" PRIu64 " (next=%" PRIu64 ", highest=%" PRIu64 ")\n",
+               seq, pb->next_seq, pb->highest_seq);
+    } else {
+        add_ms(&slot->deadline, &now, PLAYOUT_DELAY_MS);
+    }
+
+    memcpy(slot->packet, packet, size);
+    slot->packet_size = size;
+    slot->seq = seq;
+    slot->timestamp = ntohl(packet->header.timestamp);
+    slot->arrival_time = now;
+    slot->state = PLAYOUT_PRESENT;
+    pb->count++;
+    if (seq > pb->highest_seq) pb->highest_seq = seq;
+    return result;
+}
+
+rtp_packet_t* playout_buffer_get(playout_buffer_t *pb, size_t *size, uint64_t *seq, stats_t *stats) {
+    if (!pb->initialized) {
+        return NULL;
+    }
+
+    struct timeval now;
+    get_monotonic_time(&now);
+
+    while (pb->next_seq <= pb->highest_seq) {
+        playout_slot_t *slot = &pb->slots[pb->next_seq % pb->capacity];
+        if (slot->state != PLAYOUT_EMPTY && before(&now, &slot->deadline)) {
+            return NULL;
+        }
+
+        pb->next_seq++;
+        if (slot->state == PLAYOUT_PRESENT) {
+            slot->state = PLAYOUT_EMPTY;
+            pb->count--;
+            pb->last_arrival = slot->arrival_time;
+            *size = slot->packet_size;
+            *seq = slot->seq;
+            return slot->packet;
+        }
+
+        // Its wait is over (or it was never marked): give it up
+        slot->state = PLAYOUT_EMPTY;
+        if (stats != NULL) {
+            stats->packets_lost++;
+        }
+    }
+    return NULL;
+}
+
+uint32_t playout_buffer_oldest_timestamp(playout_buffer_t *pb) {
+    if (pb->count == 0) {
+        return 0;
+    }
+    for (uint64_t s = pb->next_seq; s <= pb->highest_seq; s++) {
+        playout_slot_t *slot = &pb->slots[s % pb->capacity];
+        if (slot->state == PLAYOUT_PRESENT) {
+            return slot->timestamp;
+        }
+    }
+    return 0;
+}
+
+int playout_buffer_discard_before(playout_buffer_t *pb, uint32_t keep_timestamp, int *packets_dropped) {
+    int frames = 0;
+    uint32_t last_dropped = 0;
+
+    // Frames leave in sequence order, so everything before the first packet
+    // kept belongs to a stale frame or a gap inside one
+    while (pb->count > 0 && pb->next_seq <= pb->highest_seq) {
+        playout_slot_t *slot = &pb->slots[pb->next_seq % pb->capacity];
+        if (slot->state == PLAYOUT_PRESENT) {
+            if (!rtp_timestamp_before(slot->timestamp, keep_timestamp)) {
+                break;
+            }
+            if (frames == 0 || slot->timestamp != last_dropped) frames++;
+            last_dropped = slot->timestamp;
+            pb->count--;
+            (*packets_dropped)++;
+        }
+        slot->state = PLAYOUT_EMPTY;
+        pb->next_seq++;
+    }
+    return frames;
+}
@@ -0,0 +1,90 @@
+#ifndef PLAYOUT_BUFFER_H
+#define PLAYOUT_BUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "rtp.h"
+#include "stats.h"
+#include "arena.h"
+#include "buffer_config.h"
+
+#define PLAYOUT_BUFFER_SIZE 128     // minimum window in packets, see buffer_config.h
+#define PLAYOUT_DELAY_MS 8          // each packet is held this long after it arrives
+#define PLAYOUT_SLOT_SIZE 2048      // initial slot size, grown to the largest packet seen
+
+// Results of playout_buffer_insert besides -1
+#define PLAYOUT_IN_ORDER 0
+#define PLAYOUT_REORDERED 1         // filled a gap left by a later packet
+#define PLAYOUT_STALE 2             // duplicate, or already released or given up
+
+#define PLAYOUT_EMPTY 0
+#define PLAYOUT_PRESENT 1
+#define PLAYOUT_MISSING 2           // a later packet arrived first
+
+typedef struct {
+    rtp_packet_t *packet;   // slot_capacity bytes, only packet_size of them used
+    size_t slot_capacity;
+    size_t packet_size;
+    uint64_t seq;           // extended sequence number
+    uint32_t timestamp;
+    struct timeval arrival_time;
+    struct timeval deadline;    // present: when it is due; missing: when it is given up
+    int state;
+} playout_slot_t;
+
+// Packets from arrival to frame assembly, indexed by sequence number: seq
+// lives in slot seq % capacity, so the window [next_seq, next_seq +
+// capacity) never collides. Replaces a jitter FIFO followed by a reorder
+// buffer with one copy and one deadline per slot. A packet is due
+// PLAYOUT_DELAY_MS after it arrives (at once if it fills a gap that held
+// later packets back); a missing one is given up at the deadline the caller
+// gives when a later packet shows it is missing, its frame's playout
+// deadline, which leaves room for NACK retries. Packets leave in sequence
+// order as soon as everything before them has left or been given up and
+// they are due.
+// The window runs across frame boundaries, so losing a frame's first
+// packet is noticed like any other.
+typedef struct {
+    playout_slot_t *slots;
+    int capacity;
+    arena_t *arena;         // slot memory, NULL for the heap
+    size_t slot_size;       // datagram size or the largest packet seen, what new slots are carved at
+    uint64_t next_seq;      // next to release
+    uint64_t highest_seq;   // newest inserted
+    int initialized;
+    int count;              // packets held
+    struct timeval last_arrival; // arrival of the packet playout_buffer_get last returned
+    int resizes;
+    buffer_overflow_t overflow; // when to grow rather than drop
+} playout_buffer_t;
+
+// Slots are carved from arena (NULL for the heap) as they are first used,
+// at slot_size bytes (0 for PLAYOUT_SLOT_SIZE) until a larger packet arrives
+int init_playout_buffer(playout_buffer_t *pb, int capacity, size_t slot_size, arena_t *arena);
+void free_playout_buffer(playout_buffer_t *pb);
+
+// Empties the buffer; the next packet inserted starts a new window
+void reset_playout_buffer(playout_buffer_t *pb);
+
+// Copies the packet in. Sequence numbers it skips are marked missing until
+// gap_deadline. Returns -1 for a packet beyond the window, unless such
+// packets keep coming: then the window doubles (up to BUFFER_MAX_PACKETS).
+// Otherwise returns a PLAYOUT_ result.
+int playout_buffer_insert(playout_buffer_t *pb, uint64_t seq, rtp_packet_t *packet, size_t size,
+                          const struct timeval *gap_deadline);
+
+// Next packet in sequence order if it is due, skipping missing ones whose
+// wait is over (counted in stats->packets_lost). The packet stays valid
+// until its slot is reused, a whole window later.
+rtp_packet_t* playout_buffer_get(playout_buffer_t *pb, size_t *size, uint64_t *seq, stats_t *stats);
+
+// RTP timestamp of the next packet to be released, 0 if empty
+uint32_t playout_buffer_oldest_timestamp(playout_buffer_t *pb);
+
+// Drops every packet of a frame older than keep_timestamp, and any gap
+// among them, moving the window to the first packet kept. Returns the
+// number of frames dropped and adds the packets to *packets_dropped.
+int playout_buffer_discard_before(playout_buffer_t *pb, uint32_t keep_timestamp, int *packets_dropped);
+
+#endif // PLAYOUT_BUFFER_H
@@ -0,0 +1,61 @@
+#include <string.h>
+#include "playout_clock.h"
+
+// Milliseconds of the monotonic clock, wrapping like an RTP timestamp
+static uint32_t clock_ms(const struct timeval *tv) {
+    return (uint32_t)(tv->tv_sec * 1000 + tv->tv_usec / 1000);
+}
+
+void init_playout_clock(playout_clock_t *clock) {
+    memset(clock, 0, sizeof(playout_clock_t));
+}
+
+void playout_clock_update(playout_clock_t *clock, uint32_t timestamp, const struct timeval *arrival) {
+    uint32_t transit = clock_ms(arrival) - timestamp;
+    if (!clock->initialized) {
+        memset(clock, 0, sizeof(playout_clock_t));
+        clock->offset_ms = transit;
+        clock->frame_timestamp = timestamp;
+        clock->initialized = 1;
+        return;
+    }
+
+    // A quicker packet than any before: everything seen so far arrived
+    // that much later than thought
+    int32_t late = (int32_t)(transit - clock->offset_ms);
+    if (late < 0) {
+        clock->offset_ms = transit;
+        for (int i = 0; i < PLAYOUT_SPREAD_FRAMES; i++) {
+            clock->frame_late_ms[i] += (uint32_t)-late;
+        }
+        late = 0;
+    }
+
+    // A newer frame takes the oldest slot, so a stall only stretches the
+    // spread until PLAYOUT_SPREAD_FRAMES frames have arrived on time
+    if (rtp_timestamp_before(clock->frame_timestamp, timestamp)) {
+        clock->frame_timestamp = timestamp;
+        clock->frame_index = (clock->frame_index + 1) % PLAYOUT_SPREAD_FRAMES;
+        clock->frame_late_ms[clock->frame_index] = 0;
+    }
+    if ((uint32_t)late > clock->frame_late_ms[clock->frame_index]) {
+        clock->frame_late_ms[clock->frame_index] = (uint32_t)late;
+    }
+}
+
+void playout_clock_deadline(const playout_clock_t *clock, uint32_t timestamp,
+                            const struct timeval *now, struct timeval *deadline) {
+    long left_ms = PLAYOUT_DELAY_MS + PLAYOUT_RECOVERY_MS;
+    if (clock->initialized) {
+        uint32_t spread = 0;
+        for (int i = 0; i < PLAYOUT_SPREAD_FRAMES; i++) {
+            if (clock->frame_late_ms[i] > spread) spread = clock->frame_late_ms[i];
+        }
+        uint32_t due = timestamp + clock->offset_ms + spread + PLAYOUT_DELAY_MS + PLAYOUT_RECOVERY_MS;
+        left_ms = (int32_t)(due - clock_ms(now));
+    }
+
+    int64_t due_us = (int64_t)now->tv_sec * 1000000 + now->tv_usec + (int64_t)left_ms * 1000;
+    deadline->tv_sec = (time_t)(due_us / 1000000);
+    deadline->tv_usec = (suseconds_t)(due_us % 1000000);
+}
@@ -0,0 +1,40 @@
+#ifndef PLAYOUT_CLOCK_H
+#define PLAYOUT_CLOCK_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "rtp.h"
+#include "nack_buffer.h"
+#include "playout_buffer.h"
+
+// Time a frame keeps for recovering lost packets after its last packet is
+// due: room for every NACK attempt, each a round trip after the one before
+#define PLAYOUT_RECOVERY_MS (NACK_MAX_RETRIES * RTT_MS)
+#define PLAYOUT_SPREAD_FRAMES 8     // frames the arrival spread is taken over
+
+// Maps RTP timestamps (sender milliseconds) onto the monotonic clock, so
+// every frame gets one playout deadline: its timestamp, plus the quickest
+// transit seen, plus the spread (how late after that the packets of recent
+// frames arrived: the sender pacing a frame out, and jitter), plus
+// PLAYOUT_DELAY_MS and PLAYOUT_RECOVERY_MS. Only the difference between the
+// two clocks is used, so sender and receiver need not share one.
+typedef struct {
+    uint32_t offset_ms;         // arrival minus RTP timestamp of the quickest packet
+    uint32_t frame_late_ms[PLAYOUT_SPREAD_FRAMES]; // latest arrival of each recent frame, past offset_ms
+    int frame_index;            // slot of the newest frame
+    uint32_t frame_timestamp;
+    int initialized;
+} playout_clock_t;
+
+void init_playout_clock(playout_clock_t *clock);
+
+// Called for every packet sent once, as it arrives; retransmissions would
+// stretch the spread by the very recovery time it makes room for
+void playout_clock_update(playout_clock_t *clock, uint32_t timestamp, const struct timeval *arrival);
+
+// When the frame stamped timestamp is played out, after which a packet of
+// it that is still missing is of no use
+void playout_clock_deadline(const playout_clock_t *clock, uint32_t timestamp,
+                            const struct timeval *now, struct timeval *deadline);
+
+#endif // PLAYOUT_CLOCK_H
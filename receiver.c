@@ -0,0 +1,534 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "receiver.h"
+#include "time_utils.h"
+#include "frame_hash.h"
+#include "trace.h"
+
+
+int is_valid_jpeg(uint8_t *buf, size_t size) {
+    if (size < 4) return 0;
+
+    if (buf[0] != 0xFF || buf[1] != 0xD8) return 0;
+    if (buf[size-2] != 0xFF || buf[size-1] != 0xD9) return 0;
+
+    return 1;
+}
+
+void save_frame(uint8_t *buffer, size_t size, int frame_num) {
+    if (!is_valid_jpeg(buffer, size)) {
+        return;
+    }
+    char filename[64];
+    snprintf(filename, sizeof(filename), "frames/received_frame_%04d.jpg", frame_num);
+    // Plain write(2) rather than stdio, which allocates a FILE and a buffer per frame
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("Failed to save frame");
+        return;
+    }
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, buffer + written, size - written);
+        if (n <= 0) {
+            perror("Failed to save frame");
+            break;
+        }
+        written += (size_t)n;
+    }
+    close(fd);
+    if (written == size) {
+        printf("Saved frame %d to %s\n", frame_num, filename);
+    }
+}
+
+
+static void update_buffer_stats(receiver_t *rx) {
+    rx->stats.buffer_resizes = rx->playout_buf.resizes + rx->nack_buf.resizes + rx->frame_resizes;
+    rx->stats.playout_capacity = rx->playout_buf.capacity;
+    rx->stats.nack_capacity = rx->nack_buf.capacity;
+    rx->stats.frame_capacity = rx->frame_capacity;
+    rx->stats.arena_used = rx->arena.used;
+    rx->stats.arena_size = rx->arena.size;
+    rx->stats.arena_fallbacks = rx->arena.heap_fallbacks;
+}
+
+// Room for the three frame buffers and for every playout slot at the
+// session's datagram size, each rounded up to a cache line. Only the pages
+// actually used are backed unless the arena is locked.
+static size_t receiver_arena_size(const buffer_config_t *config, size_t datagram_size) {
+    return 3 * (config->frame_bytes + ARENA_ALIGN) +
+           (size_t)config->playout_packets * (datagram_size + ARENA_ALIGN);
+}
+
+int init_receiver(receiver_t *rx, transport_t *transport, const buffer_config_t *config,
+                  size_t datagram_size) {
+    memset(rx, 0, sizeof(receiver_t));
+    rx->transport = transport;
+    rx->save_frames = 1;
+    init_seq_tracker(&rx->seq_tracker);
+    init_playout_clock(&rx->playout_clock);
+    init_stats(&rx->stats);
+    init_frame_cache(&rx->ack_cache);
+
+    if (datagram_size == 0) datagram_size = PLAYOUT_SLOT_SIZE;
+    if (init_arena(&rx->arena, receiver_arena_size(config, datagram_size), config->hugepages,
+                   config->lock_memory) < 0) {
+        return -1;
+    }
+    print_arena(&rx->arena, "Receive buffer");
+
+    rx->frame_capacity = config->frame_bytes;
+    rx->frame_buffer = (uint8_t*)arena_alloc(&rx->arena, rx->frame_capacity);
+    rx->last_complete_frame = (uint8_t*)arena_alloc(&rx->arena, rx->frame_capacity);
+    rx->conceal_buffer = (uint8_t*)arena_alloc(&rx->arena, rx->frame_capacity);
+    if (!rx->frame_buffer || !rx->last_complete_frame || !rx->conceal_buffer ||
+        init_playout_buffer(&rx->playout_buf, config->playout_packets, datagram_size, &rx->arena) < 0 ||
+        init_nack_buffer(&rx->nack_buf, config->nack_entries) < 0) {
+        perror("Buffer allocation failed");
+        free_receiver(rx);
+        return -1;
+    }
+    init_frame_assembler(&rx->assembler, rx->frame_buffer, rx->frame_capacity);
+    update_buffer_stats(rx);
+    return 0;
+}
+
+void free_receiver(receiver_t *rx) {
+    free_playout_buffer(&rx->playout_buf);
+    free_nack_buffer(&rx->nack_buf);
+    free_jpeg_layout(&rx->reference_layout);
+    free_frame_cache(&rx->ack_cache);
+    free_frame_assembler(&rx->assembler);
+    arena_release(&rx->arena, rx->frame_buffer);
+    arena_release(&rx->arena, rx->last_complete_frame);
+    arena_release(&rx->arena, rx->conceal_buffer);
+    rx->frame_buffer = NULL;
+    rx->last_complete_frame = NULL;
+    rx->conceal_buffer = NULL;
+    free_arena(&rx->arena);
+}
+
+static void catch_up(receiver_t *rx, uint32_t oldest);
+static uint32_t oldest_pending_timestamp(receiver_t *rx);
+
+// Control packets share the socket with RTP and never read as version 2
+static void handle_control_packet(receiver_t *rx, uint8_t *data, size_t len) {
+    if (len >= sizeof(probe_packet_t) && data[0] == PACKET_TYPE_PROBE) {
+        send_probe_ack(rx->transport, (probe_packet_t*)data, len);
+    }
+}
+
+// Network time of a frame: from the sender stamping it to its first packet
+// arriving, then until its marker packet arrives
+static void trace_arrival(receiver_t *rx, rtp_packet_t *packet, uint64_t seq) {
+    uint32_t timestamp = ntohl(packet->header.timestamp);
+    if (timestamp != rx->trace_arrival_frame || rx->trace_first_arrival_us == 0) {
+        rx->trace_arrival_frame = timestamp;
+        trace_span("in_flight", timestamp, trace_rtp_time_us(timestamp), seq);
+        rx->trace_first_arrival_us = trace_now_us();
+    }
+    trace_instant("arrive", timestamp, seq);
+    if (packet->header.marker && timestamp == rx->trace_arrival_frame) {
+        trace_span("receive", timestamp, rx->trace_first_arrival_us, seq);
+    }
+}
+
+void receiver_handle_packet(receiver_t *rx, rtp_packet_t *packet, size_t len) {
+    if (len < sizeof(rtp_header_t) || packet->header.version != RTP_VERSION) {
+        handle_control_packet(rx, (uint8_t*)packet, len);
+        return;
+    }
+
+    size_t datagram_len = len;
+    if (rx->srtp) {
+        uint64_t protected_seq = extend_seq(seq_tracker_max(&rx->seq_tracker),
+                                            ntohs(packet->header.sequence));
+        int plain_len = srtp_unprotect(rx->srtp, packet, len, protected_seq);
+        if (plain_len == SRTP_ERR_DUPLICATE) {
+            rx->stats.srtp_duplicates++;
+            return;
+        }
+        if (plain_len == SRTP_ERR_REPLAY) {
+            rx->stats.srtp_replayed++;
+            return;
+        }
+        if (plain_len < 0) {
+            rx->stats.srtp_auth_failures++;
+            return;
+        }
+        len = plain_len;
+    }
+
+    rx->stats.packets_received++;
+    if (datagram_len > rx->stats.max_datagram_size) rx->stats.max_datagram_size = datagram_len;
+    rx->stats.total_bytes += len;
+
+    uint64_t max_seq = seq_tracker_max(&rx->seq_tracker);
+    int first_packet = !rx->seq_tracker.initialized;
+    uint64_t seq = seq_tracker_update(&rx->seq_tracker, ntohs(packet->header.sequence));
+    uint32_t timestamp = ntohl(packet->header.timestamp);
+
+    if (!rx->newest_known || rtp_timestamp_before(rx->newest_timestamp, timestamp)) {
+        rx->newest_timestamp = timestamp;
+        rx->newest_known = 1;
+    }
+
+    struct timeval now;
+    get_monotonic_time(&now);
+    if (clear_nack_entry(&rx->nack_buf, seq)) {
+        rx->stats.packets_recovered++;
+        trace_instant("recovered", timestamp, seq);
+    } else {
+        playout_clock_update(&rx->playout_clock, timestamp, &now);
+    }
+    if (trace_active) {
+        trace_arrival(rx, packet, seq);
+    }
+
+    // Sequence numbers this packet skips belong to the frame before the
+    // gap, unless that one had ended, else to a later one; the earliest
+    // deadline they could have is the one that binds. Playout waits for
+    // them, and NACKs chase them, until then.
+    uint32_t gap_frame = (first_packet || rx->max_seq_marker) ? timestamp : rx->max_seq_timestamp;
+    struct timeval gap_deadline;
+    playout_clock_deadline(&rx->playout_clock, gap_frame, &now, &gap_deadline);
+
+    if (!first_packet && seq > max_seq + 1 && seq - max_seq < MAX_NACK_GAP) {
+        int64_t diff = (int64_t)(seq - max_seq);
+        printf("Gap detected! Last: %" PRIu64 ", Current: %" PRIu64 ". Checking %" PRId64 " packets for NACK.\n",
+                max_seq, seq, diff - 1);
+
+        long time_left_ms = nack_time_left_ms(&gap_deadline, &now);
+        for (uint64_t missing_seq = max_seq + 1; missing_seq < seq; missing_seq++) {
+            if (time_left_ms < 0) {
+                rx->stats.nacks_suppressed++;
+                continue;
+            }
+            send_nack(rx->transport, (uint16_t)missing_seq, time_left_ms + RTT_MS);
+            trace_instant("nack", timestamp, missing_seq);
+            record_nack_attempt(&rx->nack_buf, missing_seq, &gap_deadline);
+            rx->stats.retransmit_requests++;
+        }
+    }
+    if (first_packet || seq > max_seq) {
+        rx->max_seq_timestamp = timestamp;
+        rx->max_seq_marker = packet->header.marker;
+    }
+
+    // At its size limit the playout buffer would drop this packet from the
+    // middle of a frame; dropping whole stale frames instead makes room.
+    // Failing that the stream jumped too far to bridge, so start over.
+    int result = playout_buffer_insert(&rx->playout_buf, seq, packet, len, &gap_deadline);
+    if (result < 0) {
+        catch_up(rx, oldest_pending_timestamp(rx));
+        result = playout_buffer_insert(&rx->playout_buf, seq, packet, len, &gap_deadline);
+    }
+    if (result < 0) {
+        reset_playout_buffer(&rx->playout_buf);
+        result = playout_buffer_insert(&rx->playout_buf, seq, packet, len, &gap_deadline);
+    }
+    if (result == PLAYOUT_REORDERED) rx->stats.packets_reordered++;
+}
+
+static void reset_frame(receiver_t *rx) {
+    if (rx->current_timestamp != 0) {
+        rx->last_frame_timestamp = rx->current_timestamp;
+        rx->last_frame_known = 1;
+    }
+    rx->current_timestamp = 0;
+    rx->frame_crc_known = 0;
+    rx->frame_type = 0;
+    reset_frame_assembler(&rx->assembler);
+}
+
+// The delivered frame becomes the reference that later frames conceal from
+static void keep_as_reference(receiver_t *rx, uint8_t **frame, size_t size) {
+    uint8_t *old_reference = rx->last_complete_frame;
+    rx->last_complete_frame = *frame;
+    *frame = old_reference;
+    rx->last_frame_size = size;
+
+    if (jpeg_parse_layout(rx->last_complete_frame, size, &rx->reference_layout) < 0) {
+        rx->reference_layout.frame_length = 0;
+    }
+}
+
+// Delivers the current frame: as-is when every byte arrived, as its base
+// scans when a progressive frame only lacks refinement, otherwise with
+// missing restart intervals concealed from the previous frame
+static void deliver_frame(receiver_t *rx) {
+    frame_assembler_t *fa = &rx->assembler;
+    if (fa->frame_length == 0) {
+        return;
+    }
+    trace_span("assemble", rx->current_timestamp, rx->trace_assembly_start_us, fa->bytes_received);
+    uint64_t deliver_start_us = trace_now_us();
+    size_t size;
+
+    if (frame_assembler_complete(fa)) {
+        // Every byte arrived, but a damaged datagram or a fragment placed
+        // at the wrong offset still leaves a frame that only looks whole
+        if (rx->frame_crc_known && frame_assembler_crc(fa) != rx->frame_crc) {
+            printf("Frame %d failed its checksum (CRC %08x, expected %08x). Dropping.\n",
+                   rx->frame_count, fa->crc, rx->frame_crc);
+            rx->stats.frames_corrupt++;
+            trace_instant("corrupt", rx->current_timestamp, fa->frame_length);
+            return;
+        }
+        printf("Frame %d complete: %zu bytes\n", rx->frame_count, fa->frame_length);
+        if (rx->frame_type == JPEG_FRAGMENT_REPEAT) {
+            rx->stats.frames_repeated++;
+        } else {
+            // Acknowledge it so the server can send later frames against it
+            uint64_t hash = frame_hash(fa->data, fa->frame_length, NULL);
+            if (frame_cache_put(&rx->ack_cache, hash, fa->data, fa->frame_length) == 0) {
+                send_frame_ack(rx->transport, rx->current_timestamp, hash, 0);
+            }
+            if (rx->frame_type == JPEG_FRAGMENT_DELTA) rx->stats.frames_delta++;
+        }
+        if (rx->save_frames) {
+            uint64_t write_start_us = trace_now_us();
+            save_frame(fa->data, fa->frame_length, rx->frame_count);
+            trace_span("write", rx->current_timestamp, write_start_us, fa->frame_length);
+        }
+        keep_as_reference(rx, &rx->frame_buffer, fa->frame_length);
+        fa->data = rx->frame_buffer;
+    } else if ((size = frame_assembler_base_scans(fa, rx->conceal_buffer, rx->frame_capacity)) > 0) {
+        // Only refinement scans are missing: a lower-precision image of
+        // this frame beats repeating the last one
+        printf("Frame %d incomplete (%zu/%zu bytes): delivered its base scans (%zu bytes)\n",
+               rx->frame_count, fa->bytes_received, fa->frame_length, size);
+        if (rx->save_frames) {
+            uint64_t write_start_us = trace_now_us();
+            save_frame(rx->conceal_buffer, size, rx->frame_count);
+            trace_span("write", rx->current_timestamp, write_start_us, size);
+        }
+        keep_as_reference(rx, &rx->conceal_buffer, size);
+        rx->stats.frames_base_only++;
+    } else {
+        int intervals_concealed = 0;
+        size = frame_assembler_conceal(fa, rx->last_complete_frame, &rx->reference_layout,
+                                       rx->conceal_buffer, rx->frame_capacity, &intervals_concealed);
+        if (size == 0) {
+            printf("Frame %d incomplete (%zu/%zu bytes), nothing to conceal from. Dropping.\n",
+                   rx->frame_count, fa->bytes_received, fa->frame_length);
+            trace_instant("dropped", rx->current_timestamp, fa->bytes_received);
+            return;
+        }
+
+        printf("Frame %d incomplete (%zu/%zu bytes): delivered with %d restart intervals concealed\n",
+               rx->frame_count, fa->bytes_received, fa->frame_length, intervals_concealed);
+        if (rx->save_frames) {
+            uint64_t write_start_us = trace_now_us();
+            save_frame(rx->conceal_buffer, size, rx->frame_count);
+            trace_span("write", rx->current_timestamp, write_start_us, size);
+        }
+        keep_as_reference(rx, &rx->conceal_buffer, size);
+        rx->stats.frames_concealed++;
+        rx->stats.intervals_concealed += intervals_concealed;
+    }
+
+    rx->stats.frames_received++;
+    update_frame_latency(&rx->stats, rx->current_timestamp);
+    trace_span("deliver", rx->current_timestamp, deliver_start_us, rx->frame_count);
+    trace_span("frame", rx->current_timestamp, trace_rtp_time_us(rx->current_timestamp), rx->frame_count);
+    rx->frame_count++;
+}
+
+// Called before a frame larger than the buffers starts. The reference is
+// kept; the frame and concealment buffers hold nothing yet.
+static int grow_frame_buffers(receiver_t *rx, size_t frame_length) {
+    size_t capacity = buffer_grow_capacity(rx->frame_capacity, frame_length, BUFFER_MAX_FRAME_SIZE);
+    if (capacity < frame_length) {
+        return -1;
+    }
+
+    // Carved from what is left of the arena, else the heap; the outgrown
+    // arena blocks stay unused until exit
+    uint8_t *reference = (uint8_t*)arena_realloc(&rx->arena, rx->last_complete_frame,
+                                                 rx->last_frame_size, capacity);
+    if (!reference) {
+        return -1;
+    }
+    rx->last_complete_frame = reference;
+
+    uint8_t *frame = (uint8_t*)arena_alloc(&rx->arena, capacity);
+    uint8_t *conceal = (uint8_t*)arena_alloc(&rx->arena, capacity);
+    if (!frame || !conceal) {
+        arena_release(&rx->arena, frame);
+        arena_release(&rx->arena, conceal);
+        return -1;
+    }
+    arena_release(&rx->arena, rx->frame_buffer);
+    arena_release(&rx->arena, rx->conceal_buffer);
+    rx->frame_buffer = frame;
+    rx->conceal_buffer = conceal;
+    rx->frame_capacity = capacity;
+    rx->frame_resizes++;
+
+    rx->assembler.data = rx->frame_buffer;
+    rx->assembler.capacity = capacity;
+    printf("Frame of %zu bytes: frame buffers grown to %zu bytes\n", frame_length, capacity);
+    return 0;
+}
+
+// Repeat and delta fragments rebuild the frame from an acknowledged frame in
+// the cache; everything else goes straight to the assembler
+static int add_fragment(receiver_t *rx, jpeg_payload_header_t *header, uint8_t *data, size_t len) {
+    if (rx->assembler.frame_length == 0 && header->frame_length > rx->frame_capacity &&
+        grow_frame_buffers(rx, header->frame_length) < 0) {
+        return -1;
+    }
+    if (header->type != JPEG_FRAGMENT_REPEAT && header->type != JPEG_FRAGMENT_DELTA) {
+        return frame_assembler_add(&rx->assembler, header, data, len);
+    }
+
+    jpeg_reference_t reference;
+    if (parse_jpeg_reference(&data, &len, &reference) < 0) {
+        return -1;
+    }
+
+    if (rx->assembler.frame_length == 0) {
+        cached_frame_t *cached = frame_cache_get(&rx->ack_cache, reference.reference_hash);
+        if (!cached) {
+            printf("Warning: reference frame %016" PRIx64 " is not cached, cannot rebuild frame\n",
+                   reference.reference_hash);
+            rx->stats.reference_misses++;
+            // Makes the server fall back to full frames
+            send_frame_ack(rx->transport, rx->current_timestamp,
+                           reference.reference_hash, FRAME_ACK_MISS);
+            return -1;
+        }
+        size_t delta_length = (header->type == JPEG_FRAGMENT_DELTA) ? reference.delta_length : 0;
+        if (frame_assembler_set_base(&rx->assembler, cached->data, cached->length, delta_length) < 0) {
+            return -1;
+        }
+        rx->frame_type = header->type;
+    }
+
+    if (header->type == JPEG_FRAGMENT_REPEAT) {
+        return 0;
+    }
+    return frame_assembler_add(&rx->assembler, header, data, len);
+}
+
+// Packets arrive here in sequence order, so a frame ends at its marker
+// packet, or at the first packet of a later frame if the marker was lost
+static void process_ready_packet(receiver_t *rx, rtp_packet_t *ready_packet, size_t packet_size,
+                                 uint64_t seq) {
+    uint32_t timestamp = ntohl(ready_packet->header.timestamp);
+    size_t payload_size = packet_size - sizeof(rtp_header_t);
+    uint32_t frame_crc = 0;
+    int has_crc = 0;
+    int extension_size = parse_rtp_extension(ready_packet, payload_size, &frame_crc, &has_crc);
+    if (extension_size < 0) {
+        printf("Warning: Dropping packet with malformed header extension\n");
+        return;
+    }
+
+    // A packet of a frame that was already delivered or skipped would
+    // otherwise start that frame over
+    if (rx->last_frame_known && !rtp_timestamp_before(rx->last_frame_timestamp, timestamp)) {
+        printf("Ignoring late packet for delivered frame (TS %u)\n", timestamp);
+        return;
+    }
+
+    if (rx->current_timestamp != 0 && timestamp != rx->current_timestamp) {
+        printf("--- Frame boundary detected (TS change). Resetting state for Frame %d ---\n", rx->frame_count);
+        deliver_frame(rx);
+        reset_frame(rx);
+    }
+
+    if (rx->current_timestamp == 0) {
+        rx->current_timestamp = timestamp;
+        rx->trace_assembly_start_us = trace_now_us();
+    }
+    if (trace_active) {
+        trace_packet_span("playout", timestamp, seq, trace_timeval_us(&rx->playout_buf.last_arrival));
+    }
+
+    jpeg_payload_header_t jpeg_header;
+    uint8_t *fragment;
+    size_t fragment_size;
+    if (parse_jpeg_payload(ready_packet->payload + extension_size, payload_size - extension_size,
+                           &jpeg_header, &fragment, &fragment_size) < 0 ||
+        add_fragment(rx, &jpeg_header, fragment, fragment_size) < 0) {
+        printf("Warning: Dropping malformed JPEG fragment seq=%" PRIu64 "\n", seq);
+    }
+
+    if (ready_packet->header.marker) {
+        rx->frame_crc = frame_crc;
+        rx->frame_crc_known = has_crc;
+        printf("Received end of frame %d (Marker Bit)\n", rx->frame_count);
+        deliver_frame(rx);
+        reset_frame(rx);
+    }
+}
+
+// Drops every frame older than the newest one that has started arriving,
+// whether buffered or half assembled, so playout jumps to the present
+// instead of working through a backlog that only grows
+static void catch_up(receiver_t *rx, uint32_t oldest) {
+    uint32_t keep = rx->newest_timestamp;
+    int frames = 0;
+    int packets = 0;
+
+    if (rx->current_timestamp != 0 && rtp_timestamp_before(rx->current_timestamp, keep)) {
+        frames++;
+        reset_frame(rx);
+    }
+    frames += playout_buffer_discard_before(&rx->playout_buf, keep, &packets);
+    if (frames == 0) {
+        return;
+    }
+
+    printf("Client fell %u ms behind: skipped %d stale frames (%d buffered packets), resuming at timestamp %u\n",
+           keep - oldest, frames, packets, keep);
+    rx->behind = 0;
+    rx->stats.frames_skipped += frames;
+    rx->stats.catch_ups++;
+    trace_instant("catch_up", keep, frames);
+    send_skip(rx->transport, keep);
+}
+
+// The oldest frame still to be played is the one being assembled, or the
+// next one in the playout buffer; 0 if nothing is waiting
+static uint32_t oldest_pending_timestamp(receiver_t *rx) {
+    return rx->current_timestamp != 0 ? rx->current_timestamp :
+           playout_buffer_oldest_timestamp(&rx->playout_buf);
+}
+
+void receiver_process(receiver_t *rx) {
+    manage_nack_timeouts(&rx->nack_buf, rx->transport, &rx->stats);
+
+    uint32_t oldest = oldest_pending_timestamp(rx);
+    if (oldest != 0 && rx->newest_known &&
+        rtp_timestamp_before(oldest, rx->newest_timestamp - CATCHUP_BACKLOG_MS)) {
+        struct timeval now;
+        get_monotonic_time(&now);
+        if (!rx->behind) {
+            rx->behind = 1;
+            rx->behind_since = now;
+        } else if (time_diff_ms(&rx->behind_since, &now) >= CATCHUP_PERSIST_MS) {
+            catch_up(rx, oldest);
+        }
+    } else {
+        rx->behind = 0;
+    }
+
+    // Release everything that is due, so a frame of a few packets is not
+    // held back until more traffic arrives
+    size_t packet_size;
+    uint64_t seq;
+    rtp_packet_t *ready_packet;
+    while ((ready_packet = playout_buffer_get(&rx->playout_buf, &packet_size, &seq, &rx->stats)) != NULL) {
+        process_ready_packet(rx, ready_packet, packet_size, seq);
+    }
+    update_buffer_stats(rx);
+}
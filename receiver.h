@@ -0,0 +1,92 @@
+#ifndef RECEIVER_H
+#define RECEIVER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rtp.h"
+#include "stats.h"
+#include "playout_buffer.h"
+#include "playout_clock.h"
+#include "nack_buffer.h"
+#include "frame_assembler.h"
+#include "seq_tracker.h"
+#include "frame_cache.h"
+#include "buffer_config.h"
+#include "srtp.h"
+
+#define RECEIVER_POLL_MS 2   // how often the pipeline runs while no packets arrive
+#define MAX_NACK_GAP 100    // larger jumps are a restart or a burst not worth NACKing
+#define RECEIVER_MAX_BATCH 64   // datagrams read per pipeline run, so a backlog reaches the buffers
+
+// Behind by more than this (in RTP timestamp units, sender milliseconds)
+// between the frame being played out and the newest frame received, for
+// longer than CATCHUP_PERSIST_MS of client time, the client drops every
+// frame but the newest and tells the server to skip. A backlog that queued
+// in the network arrives as a burst the client clears well within the
+// persist time; skipping it would only waste what already crossed the link.
+#define CATCHUP_BACKLOG_MS 200
+#define CATCHUP_PERSIST_MS 100
+
+// Client receive pipeline: gap detection and NACKs, playout buffer and
+// frame assembly with concealment. The client feeds it
+// from the socket, replay feeds it from a capture file.
+typedef struct {
+    transport_t *transport;          // feedback path to the server, NULL to send none
+    srtp_t *srtp;                    // NULL when the stream arrives in the clear
+    int save_frames;
+    arena_t arena;                   // playout slots and the frame buffers
+
+    playout_buffer_t playout_buf;
+    playout_clock_t playout_clock;  // frame playout deadlines, for gaps and NACKs
+    nack_buffer_t nack_buf;
+    stats_t stats;
+
+    frame_assembler_t assembler;
+    uint8_t *frame_buffer;
+    uint8_t *last_complete_frame;   // last delivered frame, the concealment reference
+    uint8_t *conceal_buffer;
+    size_t frame_capacity;          // size of each of the three frame buffers
+    int frame_resizes;
+    size_t last_frame_size;
+    jpeg_layout_t reference_layout;
+    frame_cache_t ack_cache;        // complete frames acknowledged to the server
+    int frame_type;                 // JPEG_FRAGMENT_REPEAT/DELTA when rebuilt from the cache, else 0
+    uint32_t current_timestamp;
+    int frame_count;
+    uint32_t frame_crc;             // CRC-32C the marker packet carried
+    int frame_crc_known;
+    uint32_t last_frame_timestamp;  // frame most recently delivered or dropped
+    int last_frame_known;
+    uint32_t newest_timestamp;      // newest frame any packet has arrived for
+    int newest_known;
+    uint32_t max_seq_timestamp;     // frame of the highest sequence number so far
+    int max_seq_marker;             // and whether that packet ended it
+    int behind;                     // backlog over CATCHUP_BACKLOG_MS since behind_since
+    struct timeval behind_since;
+    seq_tracker_t seq_tracker;
+
+    // Tracing only: when the arriving frame started and when the frame
+    // being assembled started
+    uint32_t trace_arrival_frame;
+    uint64_t trace_first_arrival_us;
+    uint64_t trace_assembly_start_us;
+} receiver_t;
+
+// Playout slots are carved at datagram_size, the size the server's probes
+// settled on (0 for PLAYOUT_SLOT_SIZE). Larger packets later get larger
+// slots, from the heap once the arena is used up.
+int init_receiver(receiver_t *rx, transport_t *transport, const buffer_config_t *config,
+                  size_t datagram_size);
+void free_receiver(receiver_t *rx);
+
+// Called for every datagram as it arrives
+void receiver_handle_packet(receiver_t *rx, rtp_packet_t *packet, size_t len);
+
+// Called after every batch of packets and at least every RECEIVER_POLL_MS:
+// NACK retries, catch-up if the backlog grew too long, then playout
+// release and frame assembly of every packet that is due
+void receiver_process(receiver_t *rx);
+
+void save_frame(uint8_t *buffer, size_t size, int frame_num);
+
+#endif // RECEIVER_H
@@ -1,93 +1,165 @@
 #include "reorder_buffer.h"
 #include <stdio.h> // For printf (logging/warnings)
+#include <inttypes.h>
 #include "time_utils.h"
+#include "buffer_config.h"
 
-// Initialize reorder buffer and allocate memory for slots
-void init_reorder_buffer(reorder_buffer_t *buffer) {
+// Initialize reorder buffer; slot memory is carved as packets arrive
+int init_reorder_buffer(reorder_buffer_t *buffer, int capacity, arena_t *arena) {
     memset(buffer, 0, sizeof(reorder_buffer_t));
+    buffer->arena = arena;
+    buffer->slot_size = REORDER_SLOT_SIZE;
+    if (capacity < REORDER_BUFFER_SIZE) capacity = REORDER_BUFFER_SIZE;
+
+    buffer->slots = (packet_slot_t*)calloc(capacity, sizeof(packet_slot_t));
+    if (!buffer->slots) {
+        fprintf(stderr, "Error: Failed to allocate reorder buffer of %d packets\n", capacity);
+        return -1;
+    }
+    buffer->capacity = capacity;
+    buffer->initialized = 0;
+    get_monotonic_time(&buffer->packet_wait_time);
+    return 0;
+}
+
+void reset_reorder_buffer(reorder_buffer_t *buffer) {
+    buffer->expected_seq = 0;
+    buffer->highest_seq = 0;
     buffer->initialized = 0;
     get_monotonic_time(&buffer->packet_wait_time);
 
-    for (int i = 0; i < REORDER_BUFFER_SIZE; i++) {
-    
-        buffer->slots[i].data = (uint8_t*)malloc(2000);
+    for (int i = 0; i < buffer->capacity; i++) {
         buffer->slots[i].valid = 0;
-        if (!buffer->slots[i].data) {
-            fprintf(stderr, "Error: Failed to allocate memory for reorder buffer slot %d\n", i);
-        }
+        buffer->slots[i].seq = 0;
+        buffer->slots[i].size = 0;
     }
 }
 
 void free_reorder_buffer(reorder_buffer_t *buffer) {
-    for (int i = 0; i < REORDER_BUFFER_SIZE; i++) {
-        if (buffer->slots[i].data) {
-            free(buffer->slots[i].data);
-            buffer->slots[i].data = NULL; 
+    for (int i = 0; i < buffer->capacity; i++) {
+        arena_release(buffer->arena, buffer->slots[i].data);
+    }
+    free(buffer->slots);
+    buffer->slots = NULL;
+    buffer->capacity = 0;
+}
+
+// Re-homes every buffered packet at seq % new capacity, reusing the old
+// slot allocations for the rest
+static int grow(reorder_buffer_t *buffer, size_t needed) {
+    size_t capacity = buffer_grow_capacity(buffer->capacity, needed, BUFFER_MAX_PACKETS);
+    if (capacity < needed) {
+        return -1;
+    }
+
+    // Slot table on the heap, so the outgrown one can be freed; only the
+    // packet data lives in the arena
+    packet_slot_t *grown = (packet_slot_t*)calloc(capacity, sizeof(packet_slot_t));
+    if (!grown) {
+        return -1;
+    }
+    for (int i = 0; i < buffer->capacity; i++) {
+        if (buffer->slots[i].valid) {
+            grown[buffer->slots[i].seq % capacity] = buffer->slots[i];
         }
     }
+    size_t spare = 0;
+    for (int i = 0; i < buffer->capacity; i++) {
+        if (buffer->slots[i].valid || !buffer->slots[i].data) continue;
+        while (grown[spare].valid) spare++;
+        grown[spare].data = buffer->slots[i].data;
+        grown[spare].capacity = buffer->slots[i].capacity;
+        spare++;
+    }
+
+    free(buffer->slots);
+    buffer->slots = grown;
+    buffer->capacity = (int)capacity;
+    buffer->resizes++;
+    printf("Reorder buffer window grown to %d packets\n", buffer->capacity);
+    return 0;
 }
 
-int insert_packet(reorder_buffer_t *buffer, uint16_t seq, uint8_t *data, size_t size) {
+int insert_packet(reorder_buffer_t *buffer, uint64_t seq, uint8_t *data, size_t size) {
     if (!buffer->initialized) {
         buffer->expected_seq = seq;
+        buffer->highest_seq = seq;
         buffer->initialized = 1;
     }
 
-    int16_t offset = (int16_t)(seq - buffer->expected_seq);
+    int64_t offset = (int64_t)(seq - buffer->expected_seq);
     if (offset < 0) {
-        printf("Ignoring old packet: seq=%u (expected=%u)\n", seq, buffer->expected_seq);
+        printf("Ignoring old packet: seq=%" PRIu64 " (expected=%" PRIu64 ")\n", seq, buffer->expected_seq);
         return 0;
     }
-    else if (offset >= REORDER_BUFFER_SIZE) {
+    else if (offset >= buffer->capacity &&
+             (!buffer_overflow_sustained(&buffer->overflow) || grow(buffer, (size_t)offset + 1) < 0)) {
    
-        printf("Warning: Packet too far ahead, buffer full moving reorder buffer (seq=%u, expected=%u)\n",
+        printf("Warning: Packet too far ahead, buffer full moving reorder buffer (seq=%" PRIu64 ", expected=%" PRIu64 ")\n",
                 seq, buffer->expected_seq);
         
         return 0;
     }
         
-    int slot_index = offset;
+    packet_slot_t *slot = &buffer->slots[seq % buffer->capacity];
 
-    if (buffer->slots[slot_index].valid) {
+    if (slot->valid) {
         return 0;
     }
 
-    buffer->slots[slot_index].seq = seq;
-    memcpy(buffer->slots[slot_index].data, data, size);
-    buffer->slots[slot_index].size = size;
-    buffer->slots[slot_index].valid = 1;
+    // Payload size follows the negotiated datagram size, so grow to fit
+    if (size > slot->capacity) {
+        if (size > buffer->slot_size) buffer->slot_size = size;
+        uint8_t *grown = (uint8_t*)arena_realloc(buffer->arena, slot->data, 0, buffer->slot_size);
+        if (!grown) {
+            fprintf(stderr, "Error: Failed to grow reorder buffer slot to %zu bytes\n", size);
+            return 0;
+        }
+        slot->data = grown;
+        slot->capacity = buffer->slot_size;
+    }
+
+    slot->seq = seq;
+    memcpy(slot->data, data, size);
+    slot->size = size;
+    slot->valid = 1;
+    if (seq > buffer->highest_seq) buffer->highest_seq = seq;
 
     if (offset > 0) {
-        printf("Buffered out-of-order packet: seq=%u at slot %d (expected=%u)\n",
-            seq, slot_index, buffer->expected_seq);
+        printf("Buffered out-of-order packet: seq=%" PRIu64 " at offset %" PRId64 " (expected=%" PRIu64 ")\n",
+            seq, offset, buffer->expected_seq);
         return 1;
     }
 
     return 0;
 }
 
+// Moves past expected_seq, returning its slot's data (valid until the slot
+// is reused, a whole window later)
 uint8_t* shift_seq(reorder_buffer_t *buffer) {
+    packet_slot_t *slot = &buffer->slots[buffer->expected_seq % buffer->capacity];
     buffer->expected_seq++;
 
-    uint8_t* data_to_return = buffer->slots[0].data; 
-    for (int i = 0; i < REORDER_BUFFER_SIZE - 1; i++) {
-        buffer->slots[i] = buffer->slots[i + 1];
-    }
-
-    buffer->slots[REORDER_BUFFER_SIZE - 1].data = data_to_return;
-    buffer->slots[REORDER_BUFFER_SIZE - 1].valid = 0;
-    buffer->slots[REORDER_BUFFER_SIZE - 1].seq = 0;
-    buffer->slots[REORDER_BUFFER_SIZE - 1].size = 0;
+    slot->valid = 0;
+    slot->seq = 0;
+    slot->size = 0;
     get_monotonic_time(&buffer->packet_wait_time);
-    return data_to_return;
+    return slot->data;
 }
 
 
 uint8_t* get_next_packet(reorder_buffer_t *buffer, size_t *size, stats_t *stats) {
+    packet_slot_t *slot = &buffer->slots[buffer->expected_seq % buffer->capacity];
+
+    if (slot->valid && slot->seq == buffer->expected_seq) {
+        *size = slot->size;
+        return shift_seq(buffer);
+    }
 
-    if (buffer->slots[0].valid && buffer->slots[0].seq == buffer->expected_seq) {
-        *size = buffer->slots[0].size;
-        return shift_seq(buffer);;
+    // Only a later packet shows the expected one is missing; a duplicate
+    // or late retransmission arriving alone is no evidence of a gap
+    if (buffer->highest_seq <= buffer->expected_seq) {
+        return NULL;
     }
 
     struct timeval now;
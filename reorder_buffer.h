@@ -6,32 +6,49 @@
 #include <string.h>
 #include <sys/time.h>
 #include "stats.h"
+#include "arena.h"
+#include "buffer_config.h"
 
-#define REORDER_BUFFER_SIZE 101 
+#define REORDER_BUFFER_SIZE 101 // minimum window in packets, see buffer_config.h
 #define NEXT_PACKET_WAIT_MS 15
+#define REORDER_SLOT_SIZE 2048  // initial slot size, grown to the largest payload seen
 
 
 typedef struct {
-    uint16_t seq;           
-    uint8_t *data;          
+    uint64_t seq;           // extended sequence number
+    uint8_t *data;          // allocated on first use
     size_t size;         
+    size_t capacity;
     int valid;              
 
 } packet_slot_t;
 
-// Reorder buffer structure
+// Reorder buffer structure. Packet seq lives in slot seq % capacity, so the
+// window [expected_seq, expected_seq + capacity) never collides.
 typedef struct {
-    packet_slot_t slots[REORDER_BUFFER_SIZE];
-    uint16_t expected_seq;  
+    packet_slot_t *slots;
+    int capacity;
+    arena_t *arena;         // slot memory, NULL for the heap
+    size_t slot_size;       // largest payload seen, what new slots are carved at
+    uint64_t expected_seq;  
+    uint64_t highest_seq;   // newest packet inserted, evidence of a gap before it
     int initialized;        
     struct timeval packet_wait_time; 
+    int resizes;
+    buffer_overflow_t overflow; // when to grow rather than drop
 } reorder_buffer_t;
 
-void init_reorder_buffer(reorder_buffer_t *buffer);
+// Slots are carved from arena (NULL for the heap) as they are first used
+int init_reorder_buffer(reorder_buffer_t *buffer, int capacity, arena_t *arena);
 
 void free_reorder_buffer(reorder_buffer_t *buffer);
 
-int insert_packet(reorder_buffer_t *buffer, uint16_t seq, uint8_t *data, size_t size);
+// Empties the buffer for the next frame, keeping the slot allocations
+void reset_reorder_buffer(reorder_buffer_t *buffer);
+
+// A packet beyond the window is dropped, unless such packets keep coming:
+// then the window doubles (up to BUFFER_MAX_PACKETS)
+int insert_packet(reorder_buffer_t *buffer, uint64_t seq, uint8_t *data, size_t size);
 
 uint8_t* get_next_packet(reorder_buffer_t *buffer, size_t *size, stats_t *stats);
 
@@ -0,0 +1,205 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rtp.h"
+#include "receiver.h"
+#include "capture.h"
+#include "time_utils.h"
+#include "trace.h"
+#include "buffer_config.h"
+
+// Feeds a capture recorded by `client <port> <capture_file>` through the
+// same receive pipeline the client runs, with no socket involved. With
+// --fast the pipeline's clock follows the recorded arrival times instead of
+// the wall clock, so the run is a pure CPU benchmark of the receive path.
+
+#define DRAIN_STEP_US 1000
+#define DRAIN_STEPS ((PLAYOUT_DELAY_MS + PLAYOUT_RECOVERY_MS) * 4)
+
+static uint64_t wall_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(us / 1000000ULL);
+    ts.tv_nsec = (long)(us % 1000000ULL) * 1000L;
+    nanosleep(&ts, NULL);
+}
+
+static uint64_t timeval_us(struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000000ULL + (uint64_t)tv->tv_usec;
+}
+
+static void advance_time(struct timeval *tv, uint64_t us) {
+    uint64_t total = timeval_us(tv) + us;
+    tv->tv_sec = (long)(total / 1000000ULL);
+    tv->tv_usec = (long)(total % 1000000ULL);
+}
+
+// The client sizes its playout slots from the server's probes, which are not
+// recorded, so a replay sizes them from the largest media datagram captured
+static size_t largest_datagram(const char *path) {
+    static uint8_t data[sizeof(rtp_packet_t)];
+    capture_t capture;
+    if (capture_open_read(&capture, path) < 0) {
+        return 0;
+    }
+    struct timeval arrival;
+    size_t len;
+    size_t largest = 0;
+    while (capture_read(&capture, &arrival, data, sizeof(data), &len) == 1) {
+        if (len >= sizeof(probe_packet_t) && data[0] == PACKET_TYPE_PROBE) {
+            continue;
+        }
+        if (len > largest) largest = len;
+    }
+    capture_close(&capture);
+    return largest;
+}
+
+int main(int argc, char *argv[]) {
+    // Replay accepts the client's buffer options so both size buffers alike
+    buffer_config_t buffer_config;
+    init_buffer_config(&buffer_config);
+    argc = buffer_config_parse(&buffer_config, argc, argv);
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture_file> [--fast] [--save-frames] [--bitrate-kbps N] [--rtt-ms N] [--max-frame-bytes N] [--hugepages off|transparent|explicit] [--lock-memory]\n", argv[0]);
+        return 1;
+    }
+
+    int fast = 0;
+    int save = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0) {
+            fast = 1;
+        } else if (strcmp(argv[i], "--save-frames") == 0) {
+            save = 1;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    capture_t capture;
+    if (capture_open_read(&capture, argv[1]) < 0) {
+        return 1;
+    }
+
+    // Start the virtual clock at the first arrival so stats see recorded time
+    static struct timeval virtual_now;
+    virtual_now.tv_sec = 0;
+    virtual_now.tv_usec = 0;
+    advance_time(&virtual_now, capture.first_us);
+    if (fast) {
+        set_virtual_time(&virtual_now);
+    }
+
+    // With --fast the trace runs on recorded time, like the stats
+    if (trace_open("replay") < 0) {
+        capture_close(&capture);
+        return 1;
+    }
+
+    static receiver_t rx;
+    if (init_receiver(&rx, NULL, &buffer_config, largest_datagram(argv[1])) < 0) {
+        capture_close(&capture);
+        return 1;
+    }
+    rx.save_frames = save;
+
+    // Captures hold datagrams as received, so a protected session needs its key
+    static srtp_t srtp;
+    int keyed = srtp_init_from_env(&srtp);
+    if (keyed < 0) {
+        free_receiver(&rx);
+        capture_close(&capture);
+        return 1;
+    }
+    rx.srtp = keyed ? &srtp : NULL;
+
+    static rtp_packet_t packet;
+    struct timeval arrival;
+    size_t len;
+    uint64_t first_arrival_us = 0;
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    int result;
+
+    uint64_t start_ns = wall_now_ns();
+
+    while ((result = capture_read(&capture, &arrival, (uint8_t*)&packet, sizeof(packet), &len)) == 1) {
+        if (packets == 0) {
+            first_arrival_us = timeval_us(&arrival);
+        }
+
+        // Between arrivals the client wakes every RECEIVER_POLL_MS to run
+        // the pipeline, so replay does the same
+        if (fast) {
+            while (timeval_us(&arrival) > timeval_us(&virtual_now) + RECEIVER_POLL_MS * 1000ULL) {
+                advance_time(&virtual_now, RECEIVER_POLL_MS * 1000ULL);
+                receiver_process(&rx);
+            }
+            virtual_now = arrival;
+        } else {
+            uint64_t due_ns = start_ns + (timeval_us(&arrival) - first_arrival_us) * 1000ULL;
+            uint64_t now_ns = wall_now_ns();
+            while (due_ns > now_ns + RECEIVER_POLL_MS * 1000000ULL) {
+                sleep_us(RECEIVER_POLL_MS * 1000ULL);
+                receiver_process(&rx);
+                now_ns = wall_now_ns();
+            }
+            if (due_ns > now_ns) {
+                sleep_us((due_ns - now_ns) / 1000ULL);
+            }
+        }
+
+        receiver_handle_packet(&rx, &packet, len);
+        receiver_process(&rx);
+        packets++;
+        bytes += len;
+    }
+
+    // Let the last packets age out of the playout buffer
+    for (int i = 0; i < DRAIN_STEPS; i++) {
+        if (fast) {
+            advance_time(&virtual_now, DRAIN_STEP_US);
+        } else {
+            sleep_us(DRAIN_STEP_US);
+        }
+        receiver_process(&rx);
+    }
+
+    uint64_t elapsed_ns = wall_now_ns() - start_ns;
+
+    if (result < 0) {
+        fprintf(stderr, "Warning: capture truncated or corrupt after %llu packets\n",
+                (unsigned long long)packets);
+    }
+
+    print_stats(&rx.stats);
+
+    double elapsed_s = elapsed_ns / 1e9;
+    fprintf(stderr, "\n=== Replay (%s) ===\n", fast ? "fast" : "paced");
+    fprintf(stderr, "Packets: %llu (%llu bytes)\n", (unsigned long long)packets, (unsigned long long)bytes);
+    fprintf(stderr, "Frames completed: %" PRIu64 "\n", rx.stats.frames_received);
+    fprintf(stderr, "Wall time: %.3f s\n", elapsed_s);
+    if (packets > 0 && elapsed_s > 0) {
+        fprintf(stderr, "Per packet: %.1f ns\n", (double)elapsed_ns / packets);
+        fprintf(stderr, "Throughput: %.0f packets/s, %.2f Mbps, %.2f frames/s\n",
+                packets / elapsed_s, bytes * 8.0 / elapsed_s / 1e6,
+                rx.stats.frames_received / elapsed_s);
+    }
+    fprintf(stderr, "====================\n");
+
+    trace_close();
+    set_virtual_time(NULL);
+    free_receiver(&rx);
+    capture_close(&capture);
+    return 0;
+}
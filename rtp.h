@@ -6,14 +6,27 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
+#include "transport.h"
 
+// The first two bytes as RFC 3550 lays them out. GCC fills a byte's
+// bit-fields from the least significant bit on little-endian targets, so
+// they are declared in reverse there.
 typedef struct {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint8_t csrc_count:4;   
+    uint8_t extension:1;   
+    uint8_t padding:1;     
+    uint8_t version:2;     
+    uint8_t payload_type:7; 
+    uint8_t marker:1;       
+#else
     uint8_t version:2;     
     uint8_t padding:1;     
     uint8_t extension:1;   
     uint8_t csrc_count:4;   
     uint8_t marker:1;       
     uint8_t payload_type:7; 
+#endif
     uint16_t sequence;      
     uint32_t timestamp;     
     uint32_t ssrc;          
@@ -28,21 +41,96 @@ typedef struct {
     uint8_t type;           
     uint16_t seq_start;     
     uint16_t seq_count;     
+    uint16_t deadline_ms;   // time left before the client plays out past seq_start
 } __attribute__((packed)) nack_packet_t;
 
+// Path-MTU probe, padded out to probe_size bytes on the wire
+typedef struct {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t probe_id;
+    uint32_t probe_size;
+} __attribute__((packed)) probe_packet_t;
+
+// Client reply to every probe that arrived, with the largest datagram it
+// can receive so the sender never exceeds the client's buffers
+typedef struct {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t probe_id;
+    uint32_t probe_size;
+    uint32_t max_datagram;
+} __attribute__((packed)) probe_ack_packet_t;
+
+// Sent by the client for every complete frame it cached, so the server
+// knows which frames it may use as repeat/delta references. With
+// FRAME_ACK_MISS set it instead reports a reference it no longer has.
+typedef struct {
+    uint8_t type;
+    uint8_t flags;
+    uint8_t reserved[2];
+    uint32_t timestamp;     // RTP timestamp of the frame
+    uint32_t hash_high;     // frame_hash() of the frame, network byte order halves
+    uint32_t hash_low;
+} __attribute__((packed)) frame_ack_packet_t;
+
+// Sent by the client when it has fallen behind and discarded every frame
+// older than timestamp; the server stops retransmitting those frames
+typedef struct {
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t timestamp;     // newest frame the client kept
+} __attribute__((packed)) skip_packet_t;
+
 #define RTP_VERSION 2
 #define RTP_PAYLOAD_TYPE_JPEG 26
 #define MAX_PACKET_SIZE 65535
 #define MAX_PAYLOAD_SIZE (MAX_PACKET_SIZE - sizeof(rtp_header_t))
+#define MAX_UDP_PAYLOAD 65507   // largest datagram IPv4 can carry
+#define IP_UDP_OVERHEAD 28      // IPv4 + UDP headers in front of each datagram
 #define DEFAULT_PORT 5004
+#define RTT_MS 13
 
 #define PACKET_TYPE_RTP 0
 #define PACKET_TYPE_NACK 1
+// Control packets sent to the client share the socket with RTP, so their
+// type byte, the first byte of the datagram, must not read as RTP version
+// 2. The version is that byte's top two bits, so RTP starts with 0x80 to
+// 0xBF, while any type below 0x40, such as 4 to 7, reads as version 0.
+#define PACKET_TYPE_PROBE 4
+#define PACKET_TYPE_PROBE_ACK 5
+#define PACKET_TYPE_FRAME_ACK 6
+#define PACKET_TYPE_SKIP 7
+
+#define FRAME_ACK_MISS 0x1
+
+// The marker packet of each frame carries the CRC-32C of the whole frame in
+// an RFC 8285 one-byte header extension: the 0xBEDE profile, a length of
+// two words, then element ID 1 with its 4-byte value and 3 bytes of padding
+#define RTP_EXTENSION_ONE_BYTE 0xBEDE
+#define RTP_EXTENSION_ID_FRAME_CRC 1
+#define RTP_FRAME_CRC_EXTENSION_SIZE 12
 
 void init_rtp_header(rtp_header_t *header, uint16_t seq, uint32_t timestamp, uint32_t ssrc);
 int create_rtp_packet(rtp_packet_t *packet, uint16_t seq, uint32_t timestamp, 
                       uint32_t ssrc, uint8_t *data, size_t data_len);
 void print_rtp_header(rtp_header_t *header);
-void send_nack(int sockfd, struct sockaddr_in *server_addr, uint16_t seq);
+
+// Inserts the frame CRC extension between the RTP header and the payload of
+// a built packet. Returns the new packet size, or -1 if it would not fit.
+int add_frame_crc_extension(rtp_packet_t *packet, int packet_size, uint32_t frame_crc);
+
+// Size of the CSRC list and header extension at the start of the payload,
+// or -1 if they overrun it. Sets *has_crc and *frame_crc when the
+// extension carries a frame CRC.
+int parse_rtp_extension(rtp_packet_t *packet, size_t payload_size,
+                        uint32_t *frame_crc, int *has_crc);
+void send_nack(transport_t *transport, uint16_t seq, long deadline_ms);
+void send_frame_ack(transport_t *transport, uint32_t timestamp, uint64_t frame_hash, uint8_t flags);
+void send_probe_ack(transport_t *transport, probe_packet_t *probe, size_t received_size);
+void send_skip(transport_t *transport, uint32_t timestamp);
+
+// RTP timestamp order with wraparound: nonzero if a is older than b
+int rtp_timestamp_before(uint32_t a, uint32_t b);
 
 #endif // RTP_H
\ No newline at end of file
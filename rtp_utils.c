@@ -30,6 +30,72 @@ int create_rtp_packet(rtp_packet_t *packet, uint16_t seq, uint32_t timestamp,
     return sizeof(rtp_header_t) + data_len;
 }
 
+int add_frame_crc_extension(rtp_packet_t *packet, int packet_size, uint32_t frame_crc) {
+    size_t payload_size = packet_size - sizeof(rtp_header_t);
+    if (payload_size + RTP_FRAME_CRC_EXTENSION_SIZE > MAX_UDP_PAYLOAD - sizeof(rtp_header_t)) {
+        return -1;
+    }
+
+    uint8_t extension[RTP_FRAME_CRC_EXTENSION_SIZE] = {0};
+    uint16_t profile = htons(RTP_EXTENSION_ONE_BYTE);
+    uint16_t words = htons((RTP_FRAME_CRC_EXTENSION_SIZE - 4) / 4);
+    uint32_t crc = htonl(frame_crc);
+    memcpy(extension, &profile, sizeof(profile));
+    memcpy(extension + 2, &words, sizeof(words));
+    extension[4] = (RTP_EXTENSION_ID_FRAME_CRC << 4) | (sizeof(crc) - 1);
+    memcpy(extension + 5, &crc, sizeof(crc));
+
+    memmove(packet->payload + sizeof(extension), packet->payload, payload_size);
+    memcpy(packet->payload, extension, sizeof(extension));
+    packet->header.extension = 1;
+    return packet_size + sizeof(extension);
+}
+
+int parse_rtp_extension(rtp_packet_t *packet, size_t payload_size,
+                        uint32_t *frame_crc, int *has_crc) {
+    size_t offset = 4 * (size_t)packet->header.csrc_count;
+    *has_crc = 0;
+    if (!packet->header.extension) {
+        return offset <= payload_size ? (int)offset : -1;
+    }
+    if (offset + 4 > payload_size) {
+        return -1;
+    }
+
+    uint8_t *extension = packet->payload + offset;
+    uint16_t profile, words;
+    memcpy(&profile, extension, sizeof(profile));
+    memcpy(&words, extension + 2, sizeof(words));
+    size_t end = offset + 4 + 4 * (size_t)ntohs(words);
+    if (end > payload_size) {
+        return -1;
+    }
+    if (ntohs(profile) != RTP_EXTENSION_ONE_BYTE) {
+        return (int)end;
+    }
+
+    // Walk the one-byte elements; ID 0 is padding and ID 15 ends the list
+    for (size_t pos = offset + 4; pos < end; ) {
+        uint8_t id = packet->payload[pos] >> 4;
+        size_t len = (packet->payload[pos] & 0x0F) + 1;
+        if (id == 0) {
+            pos++;
+            continue;
+        }
+        if (id == 15 || pos + 1 + len > end) {
+            break;
+        }
+        if (id == RTP_EXTENSION_ID_FRAME_CRC && len == sizeof(uint32_t)) {
+            uint32_t crc;
+            memcpy(&crc, packet->payload + pos + 1, sizeof(crc));
+            *frame_crc = ntohl(crc);
+            *has_crc = 1;
+        }
+        pos += 1 + len;
+    }
+    return (int)end;
+}
+
 void print_rtp_header(rtp_header_t *header) {
     printf("=== RTP Header ===\n");
     printf("Version: %d\n", header->version);
@@ -40,14 +106,70 @@ void print_rtp_header(rtp_header_t *header) {
     printf("==================\n");
 }
 
-void send_nack(int sockfd, struct sockaddr_in *server_addr, uint16_t seq) {
+void send_nack(transport_t *transport, uint16_t seq, long deadline_ms) {
     nack_packet_t nack;
     nack.type = PACKET_TYPE_NACK;
     nack.seq_start = htons(seq);
     nack.seq_count = htons(1);
+    if (deadline_ms < 0) deadline_ms = 0;
+    if (deadline_ms > 0xFFFF) deadline_ms = 0xFFFF;
+    nack.deadline_ms = htons((uint16_t)deadline_ms);
+
+    if (!transport) {
+        return; // replay has no sender to ask
+    }
     
-    sendto(sockfd, &nack, sizeof(nack), 0, 
-           (struct sockaddr*)server_addr, sizeof(*server_addr));
+    transport_send(transport, &nack, sizeof(nack));
     
-    printf("Sent NACK for seq=%u\n", seq);
+    printf("Sent NACK for seq=%u (deadline %ldms)\n", seq, deadline_ms);
+}
+void send_probe_ack(transport_t *transport, probe_packet_t *probe, size_t received_size) {
+    probe_ack_packet_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.type = PACKET_TYPE_PROBE_ACK;
+    ack.probe_id = probe->probe_id;
+    ack.probe_size = htonl((uint32_t)received_size);
+    ack.max_datagram = htonl(sizeof(rtp_packet_t) < MAX_UDP_PAYLOAD ?
+                             (uint32_t)sizeof(rtp_packet_t) : MAX_UDP_PAYLOAD);
+
+    if (!transport) {
+        return;
+    }
+
+    transport_send(transport, &ack, sizeof(ack));
+
+    printf("Acknowledged %zu-byte path probe\n", received_size);
+}
+
+void send_frame_ack(transport_t *transport, uint32_t timestamp, uint64_t frame_hash, uint8_t flags) {
+    frame_ack_packet_t ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.type = PACKET_TYPE_FRAME_ACK;
+    ack.flags = flags;
+    ack.timestamp = htonl(timestamp);
+    ack.hash_high = htonl((uint32_t)(frame_hash >> 32));
+    ack.hash_low = htonl((uint32_t)frame_hash);
+
+    if (!transport) {
+        return;
+    }
+
+    transport_send(transport, &ack, sizeof(ack));
+}
+
+void send_skip(transport_t *transport, uint32_t timestamp) {
+    skip_packet_t skip;
+    memset(&skip, 0, sizeof(skip));
+    skip.type = PACKET_TYPE_SKIP;
+    skip.timestamp = htonl(timestamp);
+
+    if (!transport) {
+        return;
+    }
+
+    transport_send(transport, &skip, sizeof(skip));
+}
+
+int rtp_timestamp_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
 }
\ No newline at end of file
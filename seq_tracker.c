@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <string.h>
+#include "seq_tracker.h"
+
+void init_seq_tracker(seq_tracker_t *tracker) {
+    memset(tracker, 0, sizeof(seq_tracker_t));
+    tracker->bad_seq = RTP_SEQ_MOD + 1;
+}
+
+uint64_t extend_seq(uint64_t reference, uint16_t seq) {
+    int16_t delta = (int16_t)(seq - (uint16_t)reference);
+    if (delta < 0 && reference < (uint64_t)(-delta)) {
+        return seq; // before the first cycle
+    }
+    return reference + delta;
+}
+
+uint64_t seq_tracker_max(seq_tracker_t *tracker) {
+    return tracker->cycles + tracker->max_seq;
+}
+
+uint64_t seq_tracker_update(seq_tracker_t *tracker, uint16_t seq) {
+    if (!tracker->initialized) {
+        tracker->max_seq = seq;
+        tracker->initialized = 1;
+        return seq_tracker_max(tracker);
+    }
+
+    uint16_t udelta = seq - tracker->max_seq;
+
+    if (udelta < MAX_DROPOUT) {
+        // In order, possibly with a gap
+        if (seq < tracker->max_seq) {
+            tracker->cycles += RTP_SEQ_MOD;
+        }
+        tracker->max_seq = seq;
+        tracker->bad_seq = RTP_SEQ_MOD + 1;
+        return seq_tracker_max(tracker);
+    }
+
+    if (udelta <= RTP_SEQ_MOD - MAX_MISORDER) {
+        // A very large jump: either a stray packet or the sender restarted.
+        // Two sequential packets after the jump mean a restart, so carry on
+        // from there with the extended sequence still moving forward.
+        if (seq == tracker->bad_seq) {
+            printf("Sequence restarted at %u (was %u)\n", seq, tracker->max_seq);
+            if (seq < tracker->max_seq) {
+                tracker->cycles += RTP_SEQ_MOD;
+            }
+            tracker->max_seq = seq;
+            tracker->bad_seq = RTP_SEQ_MOD + 1;
+            return seq_tracker_max(tracker);
+        }
+        tracker->bad_seq = (uint16_t)(seq + 1);
+    }
+
+    // Duplicate, reordered, or an unconfirmed jump
+    return extend_seq(seq_tracker_max(tracker), seq);
+}
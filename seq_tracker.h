@@ -0,0 +1,34 @@
+#ifndef SEQ_TRACKER_H
+#define SEQ_TRACKER_H
+
+#include <stdint.h>
+
+#define RTP_SEQ_MOD (1 << 16)
+#define MAX_DROPOUT 3000     // largest forward jump accepted as loss
+#define MAX_MISORDER 100     // largest backward step accepted as reordering
+
+// RFC 3550 (appendix A.1) extended sequence numbers: the 16-bit wire
+// sequence plus a count of wraps, so distances and ordering between
+// packets stay correct however long the stream runs.
+typedef struct {
+    uint16_t max_seq;       // highest wire sequence seen
+    uint64_t cycles;        // wraps seen, shifted up by 16 bits
+    uint32_t bad_seq;       // wire sequence after a large jump, RTP_SEQ_MOD + 1 if none
+    int initialized;
+} seq_tracker_t;
+
+void init_seq_tracker(seq_tracker_t *tracker);
+
+// Feeds an arriving wire sequence and returns its extended sequence.
+// Reordered and duplicate packets are extended relative to the highest
+// sequence without moving it; a large jump is only accepted once the
+// packet after it confirms the sender restarted.
+uint64_t seq_tracker_update(seq_tracker_t *tracker, uint16_t seq);
+
+// Highest extended sequence seen so far
+uint64_t seq_tracker_max(seq_tracker_t *tracker);
+
+// Extended sequence nearest to `reference` whose low 16 bits are `seq`
+uint64_t extend_seq(uint64_t reference, uint16_t seq);
+
+#endif // SEQ_TRACKER_H
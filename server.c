@@ -1,44 +1,253 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
 #include "rtp.h"
+#include "jpeg_payload.h"
 #include "time_utils.h"
+#include "seq_tracker.h"
+#include "frame_hash.h"
+#include "crc32c.h"
+#include "srtp.h"
+#include "frame_cache.h"
+#include "transport.h"
+#include "trace.h"
+#include "buffer_config.h"
 
-#define CHUNK_SIZE 1400
-#define MAX_STORED_PACKETS 1000  
+#define DEFAULT_DATAGRAM_SIZE 1400 // used until the client acknowledges a probe
+#define MIN_DATAGRAM_SIZE (576 - IP_UDP_OVERHEAD) // every IPv4 path carries this
+#define PROBE_TIMEOUT_MS 200       // wait for the next probe ack before giving up
+#define PROBE_MAX_WAIT_MS 2000
 #define WAIT_NACK_MS 5000 // amount of time waiting for final nacks
 #define GAP_WAIT_NACK_MS 2000 // amount of time waiting between final retransmission nack requests
+#define LOCAL_FRAME_GAP_MS 10 // shared-memory transport: serve NACKs for this long between frames
+#define MAX_PENDING_NACKS 256
+#define MAX_IMAGES 64
+#define DELTA_MAX_CHANGED_PCT 50   // send the whole frame when more than this changed
 
 typedef struct {
-    rtp_packet_t packet;
+    rtp_packet_t *packet;   // allocated on first use, sized to the datagram
+    size_t capacity;
     size_t size;
-    uint16_t seq;
+    uint64_t seq;           // extended sequence number
+    uint32_t timestamp;
+    int base;               // carries progressive base scans
     int valid;
 } stored_packet_t;
 
-stored_packet_t packet_storage[MAX_STORED_PACKETS];
+// Sent packets kept for retransmission at seq % capacity. Keyed by extended
+// sequence so the slot mapping stays continuous across 16-bit wraps.
+typedef struct {
+    stored_packet_t *slots;
+    size_t capacity;
+    int resizes;
+    arena_t arena;          // slot memory and the dedup reference
+    size_t slot_size;       // datagram size or the largest packet stored, what new slots are carved at
+    buffer_overflow_t overflow; // NACKs for packets already overwritten
+} packet_store_t;
+
+// A NACK waiting to be served, with the time the retransmission must go out
+// by to reach the client before it plays past the packet
+typedef struct {
+    uint64_t seq;
+    uint32_t timestamp;
+    int base;
+    struct timeval deadline;
+} pending_nack_t;
+
+typedef struct {
+    int retransmissions;
+    int stale_nacks_dropped;
+    size_t bytes_saved;
+    int skips;                  // catch-up requests from the client
+} retransmit_stats_t;
+
+typedef struct {
+    transport_t *transport;
+    srtp_t *srtp;               // NULL when the stream is sent in the clear
+    uint32_t ssrc;
+    uint64_t sequence;          // extended, the wire carries the low 16 bits
+    size_t datagram_size;       // negotiated per session, 0 until probed
+    int reprobe;                // the path MTU shrank, probe again before the next frame
+    uint32_t frame_crc;         // CRC-32C of the frame being sent, for its marker packet
+    int packets_sent;
+    int redundant_packets;      // second copies of progressive base packets
+    size_t bytes_sent;
+    retransmit_stats_t rstats;
+} sender_t;
 
-void store_packet(rtp_packet_t *packet, size_t size, uint16_t seq) {
-    int index = seq % MAX_STORED_PACKETS;
-    memcpy(&packet_storage[index].packet, packet, size);
-    packet_storage[index].size = size;
-    packet_storage[index].seq = seq;
-    packet_storage[index].valid = 1;
+typedef struct {
+    const char *file;
+    uint8_t *data;
+    size_t size;
+    jpeg_layout_t layout;
+    uint64_t *region_hashes;    // frame_region_count(size) entries
+} image_t;
+
+// Frames the client acknowledged become references for repeat and delta
+// frames. Only region hashes are needed to pick the changed regions, so
+// sent_frames keeps those of each recent frame rather than the frame itself.
+typedef struct {
+    region_cache_t sent_frames;
+    int have_reference;
+    uint64_t reference_hash;
+    uint32_t reference_timestamp;
+    size_t reference_length;
+    uint64_t *reference_regions;
+    size_t reference_capacity;
+} dedup_state_t;
+
+static volatile sig_atomic_t running = 1;
+
+static int random_ssrc(uint32_t *ssrc) {
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (!fp || fread(ssrc, sizeof(*ssrc), 1, fp) != 1) {
+        perror("Failed to pick a random SSRC");
+        if (fp) fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+packet_store_t packet_store;
+pending_nack_t pending_nacks[MAX_PENDING_NACKS];
+int pending_nack_count = 0;
+dedup_state_t dedup;
+
+// Frames older than this were discarded by a client catching up
+uint32_t skip_before_timestamp;
+int skip_requested = 0;
+
+// Region hashes of the largest frame, what the dedup reference holds
+static size_t reference_regions_size(size_t max_frame_size) {
+    return sizeof(uint64_t) * frame_region_count(max_frame_size);
 }
 
-stored_packet_t* get_stored_packet(uint16_t seq) {
-    int index = seq % MAX_STORED_PACKETS;
-    if (packet_storage[index].valid && packet_storage[index].seq == seq) {
-        return &packet_storage[index];
+// Slots are carved at the session's datagram size, each rounded up to a
+// cache line, from an arena with room for every one and for the dedup
+// reference; only the pages actually used are backed unless it is locked.
+// Should a later probe find a larger path, slots are carved again as bigger
+// packets arrive, and what no longer fits comes from the heap.
+int init_packet_store(size_t capacity, size_t datagram_size, const buffer_config_t *config) {
+    size_t size = capacity * (datagram_size + ARENA_ALIGN) +
+                  reference_regions_size(config->max_frame_size) + ARENA_ALIGN;
+    if (init_arena(&packet_store.arena, size, config->hugepages, config->lock_memory) < 0) {
+        return -1;
+    }
+    packet_store.slots = (stored_packet_t*)calloc(capacity, sizeof(stored_packet_t));
+    if (!packet_store.slots) {
+        perror("Packet storage allocation failed");
+        free_arena(&packet_store.arena);
+        return -1;
+    }
+    packet_store.capacity = capacity;
+    packet_store.resizes = 0;
+    packet_store.slot_size = datagram_size;
+    return 0;
+}
+
+void free_packet_store(void) {
+    for (size_t i = 0; i < packet_store.capacity; i++) {
+        arena_release(&packet_store.arena, packet_store.slots[i].packet);
+    }
+    free(packet_store.slots);
+    packet_store.slots = NULL;
+    packet_store.capacity = 0;
+    free_arena(&packet_store.arena);
+}
+
+// Doubles the storage (up to BUFFER_MAX_PACKETS), keeping every packet
+// still held; if two of them would share a slot, it stays as it is
+void grow_packet_store(void) {
+    size_t capacity = buffer_grow_capacity(packet_store.capacity, packet_store.capacity + 1,
+                                           BUFFER_MAX_PACKETS);
+    if (capacity <= packet_store.capacity) {
+        return;
+    }
+    // The slot table is on the heap so the old one can be freed; packets
+    // keep their arena blocks, and new slots fall back to the heap once
+    // the arena is full
+    stored_packet_t *grown = (stored_packet_t*)calloc(capacity, sizeof(stored_packet_t));
+    if (!grown) {
+        return;
+    }
+    // Packets apart by a multiple of the new capacity would share a slot,
+    // which happens once the cap stops it being a multiple of the old one
+    for (size_t i = 0; i < packet_store.capacity; i++) {
+        stored_packet_t *stored = &packet_store.slots[i];
+        if (!stored->valid) continue;
+        stored_packet_t *slot = &grown[stored->seq % capacity];
+        if (slot->valid) {
+            free(grown);
+            return;
+        }
+        *slot = *stored;
+    }
+    for (size_t i = 0; i < packet_store.capacity; i++) {
+        if (!packet_store.slots[i].valid) {
+            arena_release(&packet_store.arena, packet_store.slots[i].packet);
+        }
+    }
+    free(packet_store.slots);
+    packet_store.slots = grown;
+    packet_store.capacity = capacity;
+    packet_store.resizes++;
+    printf("Packet storage grown to %zu packets\n", capacity);
+}
+
+void store_packet(rtp_packet_t *packet, size_t size, uint64_t seq, int base) {
+    stored_packet_t *stored = &packet_store.slots[seq % packet_store.capacity];
+    if (size > stored->capacity) {
+        if (size > packet_store.slot_size) packet_store.slot_size = size;
+        rtp_packet_t *grown = (rtp_packet_t*)arena_realloc(&packet_store.arena, stored->packet, 0,
+                                                           packet_store.slot_size);
+        if (!grown) {
+            stored->valid = 0;
+            return;
+        }
+        stored->packet = grown;
+        stored->capacity = packet_store.slot_size;
+    }
+    memcpy(stored->packet, packet, size);
+    stored->size = size;
+    stored->seq = seq;
+    stored->timestamp = ntohl(packet->header.timestamp);
+    stored->base = base;
+    stored->valid = 1;
+}
+
+stored_packet_t* get_stored_packet(uint64_t seq) {
+    stored_packet_t *stored = &packet_store.slots[seq % packet_store.capacity];
+    if (stored->valid && stored->seq == seq) {
+        return stored;
     }
     return NULL;
 }
 
+// A NACK for a packet that was already overwritten means the client's
+// recovery window is longer than the storage; once that keeps happening,
+// double it
+void packet_store_missed(uint64_t seq) {
+    stored_packet_t *stored = &packet_store.slots[seq % packet_store.capacity];
+    if (stored->valid && stored->seq > seq && buffer_overflow_sustained(&packet_store.overflow)) {
+        grow_packet_store();
+    }
+}
+
 uint8_t* read_image_file(const char *filename, size_t *file_size) {
     FILE *fp = fopen(filename, "rb");
     if (!fp) {
@@ -61,150 +270,705 @@ uint8_t* read_image_file(const char *filename, size_t *file_size) {
     return buffer;
 }
 
+static int frame_skipped(uint32_t timestamp) {
+    return skip_requested && rtp_timestamp_before(timestamp, skip_before_timestamp);
+}
+
+// The client has dropped everything before the frame it kept. Frames are
+// generated live, so the next one is already the newest; what is left to
+// skip is the retransmission of packets nobody will play.
+void handle_skip(skip_packet_t *skip, retransmit_stats_t *rstats) {
+    uint32_t timestamp = ntohl(skip->timestamp);
+    if (skip_requested && !rtp_timestamp_before(skip_before_timestamp, timestamp)) {
+        return;
+    }
+    skip_before_timestamp = timestamp;
+    skip_requested = 1;
+    rstats->skips++;
+
+    int kept = 0;
+    for (int i = 0; i < pending_nack_count; i++) {
+        if (frame_skipped(pending_nacks[i].timestamp)) {
+            stored_packet_t *stored = get_stored_packet(pending_nacks[i].seq);
+            rstats->stale_nacks_dropped++;
+            rstats->bytes_saved += stored ? stored->size : 0;
+            continue;
+        }
+        pending_nacks[kept++] = pending_nacks[i];
+    }
+    printf("Client is catching up: skipping frames before timestamp %u (%d queued retransmissions dropped)\n",
+           timestamp, pending_nack_count - kept);
+    trace_instant("skip", timestamp, pending_nack_count - kept);
+    pending_nack_count = kept;
+}
+
+// The reference is carved once for the largest frame, so taking a new one
+// on every ack never allocates
+int init_dedup(size_t max_frame_size) {
+    memset(&dedup, 0, sizeof(dedup));
+    init_region_cache(&dedup.sent_frames);
+    dedup.reference_regions = (uint64_t*)arena_alloc(&packet_store.arena,
+                                                     reference_regions_size(max_frame_size));
+    if (!dedup.reference_regions) {
+        perror("Dedup reference allocation failed");
+        return -1;
+    }
+    dedup.reference_capacity = frame_region_count(max_frame_size);
+    return 0;
+}
+
+void free_dedup(void) {
+    free_region_cache(&dedup.sent_frames);
+    arena_release(&packet_store.arena, dedup.reference_regions);
+    dedup.reference_regions = NULL;
+}
+
+void handle_frame_ack(frame_ack_packet_t *ack) {
+    uint64_t hash = ((uint64_t)ntohl(ack->hash_high) << 32) | ntohl(ack->hash_low);
+    uint32_t timestamp = ntohl(ack->timestamp);
+
+    if (ack->flags & FRAME_ACK_MISS) {
+        if (dedup.have_reference && dedup.reference_hash == hash) {
+            printf("Client lost reference frame %016" PRIx64 ", sending full frames\n", hash);
+            dedup.have_reference = 0;
+        }
+        return;
+    }
+
+    // Acks can arrive out of order; only a newer frame replaces the reference
+    if (dedup.have_reference &&
+        (dedup.reference_hash == hash || (int32_t)(timestamp - dedup.reference_timestamp) <= 0)) {
+        return;
+    }
+
+    cached_regions_t *sent = region_cache_get(&dedup.sent_frames, hash);
+    if (!sent || sent->region_count > dedup.reference_capacity) {
+        return;
+    }
+
+    memcpy(dedup.reference_regions, sent->region_hashes, sizeof(uint64_t) * sent->region_count);
+    dedup.reference_length = sent->frame_length;
+    dedup.reference_hash = hash;
+    dedup.reference_timestamp = timestamp;
+    dedup.have_reference = 1;
+}
+
+// Reads every NACK and frame ack that has arrived. With wait set, the first
+// read blocks for up to 1 ms, which doubles as part of the send
+// pacing. NACKed sequences are extended relative to last_sent, the newest
+// packet.
+void collect_nacks(transport_t *transport, int wait, uint64_t last_sent, retransmit_stats_t *rstats) {
+    int timeout_ms = wait ? 1 : 0;
+
+    while (1) {
+        uint8_t feedback[64];
+        ssize_t nack_len = transport_recv(transport, feedback, sizeof(feedback), timeout_ms);
+        if (nack_len <= 0) {
+            return;
+        }
+        timeout_ms = 0;
+
+        if (nack_len >= (ssize_t)sizeof(frame_ack_packet_t) && feedback[0] == PACKET_TYPE_FRAME_ACK) {
+            handle_frame_ack((frame_ack_packet_t*)feedback);
+            continue;
+        }
+        if (nack_len >= (ssize_t)sizeof(skip_packet_t) && feedback[0] == PACKET_TYPE_SKIP) {
+            handle_skip((skip_packet_t*)feedback, rstats);
+            continue;
+        }
+        if (nack_len < (ssize_t)sizeof(nack_packet_t) || feedback[0] != PACKET_TYPE_NACK) {
+            continue;
+        }
+        nack_packet_t nack;
+        memcpy(&nack, feedback, sizeof(nack));
+
+        uint64_t missing_seq = extend_seq(last_sent, ntohs(nack.seq_start));
+        long deadline_ms = ntohs(nack.deadline_ms);
+        printf("\nReceived NACK for seq=%" PRIu64 " (deadline %ldms)\n", missing_seq, deadline_ms);
+
+        stored_packet_t *stored = get_stored_packet(missing_seq);
+        if (!stored) {
+            printf("Warning: Requested packet seq=%" PRIu64 " not in storage\n\n", missing_seq);
+            packet_store_missed(missing_seq);
+            continue;
+        }
+        if (frame_skipped(stored->timestamp)) {
+            rstats->stale_nacks_dropped++;
+            rstats->bytes_saved += stored->size;
+            continue;
+        }
+
+        int duplicate = 0;
+        for (int i = 0; i < pending_nack_count; i++) {
+            if (pending_nacks[i].seq == missing_seq) duplicate = 1;
+        }
+        if (duplicate) {
+            continue;
+        }
+
+        // The retransmission still needs half an RTT to reach the client
+        long send_by_ms = deadline_ms - RTT_MS / 2;
+        if (send_by_ms < 0 || pending_nack_count >= MAX_PENDING_NACKS) {
+            rstats->stale_nacks_dropped++;
+            rstats->bytes_saved += stored->size;
+            continue;
+        }
+
+        pending_nack_t *pending = &pending_nacks[pending_nack_count++];
+        pending->seq = missing_seq;
+        pending->timestamp = stored->timestamp;
+        pending->base = stored->base;
+        get_monotonic_time(&pending->deadline);
+        pending->deadline.tv_usec += send_by_ms * 1000L;
+        pending->deadline.tv_sec += pending->deadline.tv_usec / 1000000L;
+        pending->deadline.tv_usec %= 1000000L;
+    }
+}
+
+// Newest frame first, then a progressive frame's base scans before its
+// refinement, then sequence order
+int compare_pending_nacks(const void *a, const void *b) {
+    const pending_nack_t *na = (const pending_nack_t*)a;
+    const pending_nack_t *nb = (const pending_nack_t*)b;
+    if (na->timestamp != nb->timestamp) {
+        return ((int32_t)(nb->timestamp - na->timestamp) > 0) ? 1 : -1;
+    }
+    if (na->base != nb->base) {
+        return nb->base - na->base;
+    }
+    return (na->seq > nb->seq) - (na->seq < nb->seq);
+}
+
+void serve_nacks(transport_t *transport, retransmit_stats_t *rstats) {
+    qsort(pending_nacks, pending_nack_count, sizeof(pending_nack_t), compare_pending_nacks);
+
+    for (int i = 0; i < pending_nack_count; i++) {
+        stored_packet_t *stored = get_stored_packet(pending_nacks[i].seq);
+        if (!stored) {
+            continue;
+        }
+
+        struct timeval now;
+        get_monotonic_time(&now);
+        if (time_diff_ms(&now, &pending_nacks[i].deadline) < 0) {
+            printf("Dropping stale NACK for seq=%" PRIu64 ", client has played past it\n", pending_nacks[i].seq);
+            trace_instant("stale_nack", pending_nacks[i].timestamp, pending_nacks[i].seq);
+            rstats->stale_nacks_dropped++;
+            rstats->bytes_saved += stored->size;
+            continue;
+        }
+
+        transport_send(transport, stored->packet, stored->size);
+        trace_instant("retransmit", pending_nacks[i].timestamp, pending_nacks[i].seq);
+        rstats->retransmissions++;
+        printf("Retransmitted packet seq=%" PRIu64 "\n\n", pending_nacks[i].seq);
+    }
+    pending_nack_count = 0;
+}
+
+// Candidate datagram sizes, smallest first so a slow link still returns the
+// early acks within PROBE_TIMEOUT_MS of each other: standard Ethernet,
+// 4K, jumbo frames, 16K and the IPv4 maximum, less the IP and UDP headers
+static const size_t probe_sizes[] = {
+    1500 - IP_UDP_OVERHEAD,
+    4096 - IP_UDP_OVERHEAD,
+    9000 - IP_UDP_OVERHEAD,
+    16384 - IP_UDP_OVERHEAD,
+    MAX_UDP_PAYLOAD
+};
+#define PROBE_COUNT (sizeof(probe_sizes) / sizeof(probe_sizes[0]))
+
+// Sends one probe of each candidate size with fragmentation disabled and
+// returns the largest size the client acknowledged, capped at what the
+// client can receive. Returns 0 if nothing was acknowledged.
+size_t probe_path_mtu(transport_t *transport) {
+    static uint8_t probe_buffer[MAX_UDP_PAYLOAD];
+    static uint16_t next_probe_id = 0;
+    uint16_t first_id = next_probe_id;
+
+    for (size_t i = 0; i < PROBE_COUNT; i++) {
+        probe_packet_t *probe = (probe_packet_t*)probe_buffer;
+        probe->type = PACKET_TYPE_PROBE;
+        probe->reserved = 0;
+        probe->probe_id = htons(next_probe_id++);
+        probe->probe_size = htonl((uint32_t)probe_sizes[i]);
+
+        // EMSGSIZE means the kernel already knows the path is smaller
+        if (transport_send(transport, probe_buffer, probe_sizes[i]) < 0) {
+            printf("Probe of %zu bytes not sent: %s\n", probe_sizes[i], strerror(errno));
+        }
+    }
+
+    size_t best = 0;
+    size_t client_max = MAX_UDP_PAYLOAD;
+    struct timeval start, last_ack, now;
+    get_monotonic_time(&start);
+    last_ack = start;
+
+    while (1) {
+        get_monotonic_time(&now);
+        if (time_diff_ms(&last_ack, &now) > PROBE_TIMEOUT_MS ||
+            time_diff_ms(&start, &now) > PROBE_MAX_WAIT_MS) {
+            break;
+        }
+
+        probe_ack_packet_t ack;
+        ssize_t len = transport_recv(transport, &ack, sizeof(ack), 1);
+        if (len < (ssize_t)sizeof(ack) || ack.type != PACKET_TYPE_PROBE_ACK) {
+            continue;
+        }
+
+        uint16_t index = ntohs(ack.probe_id) - first_id;
+        if (index >= PROBE_COUNT || ntohl(ack.probe_size) != probe_sizes[index]) {
+            continue; // stale ack from an earlier round, or a truncated probe
+        }
+
+        last_ack = now;
+        client_max = ntohl(ack.max_datagram);
+        if (probe_sizes[index] > best) best = probe_sizes[index];
+        if (index == PROBE_COUNT - 1) break;
+    }
+
+    if (best > client_max) best = client_max;
+    return best;
+}
+
 uint32_t get_timestamp_ms() {
     struct timeval tv;
     get_monotonic_time(&tv);
     return (tv.tv_sec * 1000) + (tv.tv_usec / 1000);
 }
 
+size_t session_datagram_size(sender_t *s) {
+    return s->datagram_size > 0 ? s->datagram_size : DEFAULT_DATAGRAM_SIZE;
+}
+
+void probe_datagram_size(sender_t *s) {
+    s->reprobe = 0;
+    s->datagram_size = probe_path_mtu(s->transport);
+    if (s->datagram_size > 0) {
+        printf("Path probing: using %zu-byte datagrams\n", s->datagram_size);
+    } else {
+        printf("Path probing: no acknowledgement, using %d-byte datagrams\n",
+               DEFAULT_DATAGRAM_SIZE);
+    }
+}
+
+size_t max_fragment_size(sender_t *s) {
+    size_t session_size = session_datagram_size(s);
+    // Every fragment leaves room for the CRC extension, since whether it
+    // ends the frame is only known once it has been cut
+    size_t tag_size = s->srtp ? SRTP_TAG_SIZE : 0;
+    return session_size - sizeof(rtp_header_t) - RTP_FRAME_CRC_EXTENSION_SIZE - tag_size -
+           sizeof(jpeg_payload_header_t);
+}
+
+// The shared-memory ring applies its own backpressure, so only the
+// network path is paced
+void pace(sender_t *s, uint32_t timestamp, uint64_t seq) {
+    uint64_t pace_start_us = trace_now_us();
+    int local = transport_is_local(s->transport);
+    if (!local) {
+        usleep(WAIT_NACK_MS); 
+    }
+
+    collect_nacks(s->transport, !local, s->sequence - 1, &s->rstats);
+    serve_nacks(s->transport, &s->rstats);
+    trace_packet_span("pace", timestamp, seq, pace_start_us);
+}
+
+// Sends one fragment, with an optional prefix ahead of its data, keeps it
+// for retransmission and serves the NACKs that arrive while pacing.
+// Returns -1 if the datagram exceeded a path MTU that shrank since probing:
+// the fragment is not sent and the caller cuts it again, since every later
+// fragment is now at most MIN_DATAGRAM_SIZE.
+int send_fragment(sender_t *s, uint32_t timestamp, jpeg_payload_header_t *header,
+                   const uint8_t *prefix, size_t prefix_len,
+                   const uint8_t *data, size_t len, int last) {
+    static uint8_t fragment[MAX_UDP_PAYLOAD];
+    uint64_t packetize_start_us = trace_now_us();
+    if (prefix_len > 0) memcpy(fragment, prefix, prefix_len);
+    if (len > 0) memcpy(fragment + prefix_len, data, len);
+
+    rtp_packet_t packet;
+    int packet_size = create_jpeg_packet(&packet, (uint16_t)s->sequence, timestamp, s->ssrc,
+                                         header, fragment, prefix_len + len);
+    if (packet_size < 0) {
+        return 0;
+    }
+
+    if (last) {
+        packet_size = add_frame_crc_extension(&packet, packet_size, s->frame_crc);
+        if (packet_size < 0) {
+            return 0;
+        }
+        packet.header.marker = 1;
+        printf("Packet %d (seq=%" PRIu64 "): %zu bytes [LAST PACKET]\n", 
+               s->packets_sent, s->sequence, len);
+    } else if (s->packets_sent % 10 == 0) {
+        printf("Packet %d (seq=%" PRIu64 "): %zu bytes\n", 
+               s->packets_sent, s->sequence, len);
+    }
+
+    // Protected once, so a retransmission resends the same ciphertext
+    // rather than encrypting under the same IV again
+    if (s->srtp) {
+        packet_size = srtp_protect(s->srtp, &packet, packet_size, s->sequence);
+        if (packet_size < 0) {
+            return 0;
+        }
+    }
+
+    // The sequence number is not used up: the datagram never left, so
+    // protecting the smaller one under it reuses no IV on the wire
+    if (transport_send(s->transport, &packet, packet_size) < 0 &&
+        errno == EMSGSIZE && session_datagram_size(s) > MIN_DATAGRAM_SIZE) {
+        printf("Datagram of %d bytes exceeds the path MTU, sending the rest of the frame in "
+               "%d-byte datagrams and probing again next frame\n", packet_size, MIN_DATAGRAM_SIZE);
+        s->datagram_size = MIN_DATAGRAM_SIZE;
+        s->reprobe = 1;
+        return -1;
+    }
+
+    store_packet(&packet, packet_size, s->sequence, header->type == JPEG_FRAGMENT_BASE);
+    trace_packet_span("packetize", timestamp, s->sequence, packetize_start_us);
+
+    s->sequence++;
+    s->packets_sent++;
+    s->bytes_sent += packet_size;
+    pace(s, timestamp, s->sequence - 1);
+    return 0;
+}
+
+// Sends a stored packet a second time, unchanged, ahead of any NACK. The
+// receiver keeps whichever copy arrives first and drops the other.
+void send_redundant(sender_t *s, uint32_t timestamp, uint64_t seq) {
+    stored_packet_t *stored = get_stored_packet(seq);
+    if (!stored) {
+        return;
+    }
+    transport_send(s->transport, stored->packet, stored->size);
+    trace_instant("redundant", timestamp, seq);
+    s->redundant_packets++;
+    s->bytes_sent += stored->size;
+    pace(s, timestamp, seq);
+}
+
+// The file order already puts a progressive image's base scans first.
+// Each base packet also goes out a second time right after it, one pacing
+// interval later, so a single loss among them costs no round trip. The
+// copy arrives before any later sequence, so the receiver never sees a gap.
+void send_full_frame(sender_t *s, image_t *image, uint32_t timestamp) {
+    size_t offset = 0;
+    while (offset < image->size) {
+        jpeg_payload_header_t jpeg_header;
+        size_t chunk_size = jpeg_next_fragment(&image->layout, offset,
+                                               max_fragment_size(s), &jpeg_header);
+        if (send_fragment(s, timestamp, &jpeg_header, NULL, 0, image->data + offset, chunk_size,
+                          offset + chunk_size >= image->size) < 0) {
+            continue;
+        }
+        offset += chunk_size;
+
+        if (jpeg_header.type == JPEG_FRAGMENT_BASE) {
+            send_redundant(s, timestamp, s->sequence - 1);
+        }
+    }
+}
+
+// A frame identical to the acknowledged reference: one packet, no data
+void send_repeat_frame(sender_t *s, image_t *image, uint32_t timestamp) {
+    jpeg_payload_header_t jpeg_header;
+    memset(&jpeg_header, 0, sizeof(jpeg_header));
+    jpeg_header.frame_length = (uint32_t)image->size;
+    jpeg_header.type = JPEG_FRAGMENT_REPEAT;
+
+    uint8_t prefix[sizeof(jpeg_reference_t)];
+    write_jpeg_reference(prefix, dedup.reference_hash, 0);
+    send_fragment(s, timestamp, &jpeg_header, prefix, sizeof(prefix), NULL, 0, 1);
+}
+
+static int region_changed(image_t *image, size_t region) {
+    return image->region_hashes[region] != dedup.reference_regions[region];
+}
+
+static size_t region_end(image_t *image, size_t region) {
+    size_t end = (region + 1) * FRAME_REGION_SIZE;
+    return end < image->size ? end : image->size;
+}
+
+// Bytes in regions that differ from the reference, or 0 if the reference
+// has a different length and a delta is not possible
+size_t changed_bytes(image_t *image) {
+    if (dedup.reference_length != image->size) {
+        return 0;
+    }
+    size_t changed = 0;
+    for (size_t r = 0; r < frame_region_count(image->size); r++) {
+        if (region_changed(image, r)) {
+            changed += region_end(image, r) - r * FRAME_REGION_SIZE;
+        }
+    }
+    return changed;
+}
+
+// Only the changed regions, coalesced into runs and split to fit the
+// datagram; the client copies the rest from its cached reference
+void send_delta_frame(sender_t *s, image_t *image, size_t delta_length, uint32_t timestamp) {
+    uint8_t prefix[sizeof(jpeg_reference_t)];
+    write_jpeg_reference(prefix, dedup.reference_hash, (uint32_t)delta_length);
+    size_t regions = frame_region_count(image->size);
+    size_t sent = 0;
+
+    for (size_t r = 0; r < regions; r++) {
+        if (!region_changed(image, r)) continue;
+
+        size_t start = r * FRAME_REGION_SIZE;
+        while (r + 1 < regions && region_changed(image, r + 1)) r++;
+        size_t end = region_end(image, r);
+
+        for (size_t offset = start; offset < end; ) {
+            size_t max_chunk = max_fragment_size(s) - sizeof(prefix);
+            size_t chunk_size = end - offset < max_chunk ? end - offset : max_chunk;
+            jpeg_payload_header_t jpeg_header;
+            memset(&jpeg_header, 0, sizeof(jpeg_header));
+            jpeg_header.fragment_offset = (uint32_t)offset;
+            jpeg_header.frame_length = (uint32_t)image->size;
+            jpeg_header.type = JPEG_FRAGMENT_DELTA;
+
+            if (send_fragment(s, timestamp, &jpeg_header, prefix, sizeof(prefix),
+                              image->data + offset, chunk_size, sent + chunk_size == delta_length) < 0) {
+                continue;
+            }
+            sent += chunk_size;
+            offset += chunk_size;
+        }
+    }
+}
+
+int load_image(image_t *image, const char *file) {
+    memset(image, 0, sizeof(image_t));
+    image->file = file;
+    image->data = read_image_file(file, &image->size);
+    if (!image->data) {
+        return -1;
+    }
+    if (jpeg_parse_layout(image->data, image->size, &image->layout) < 0) {
+        fprintf(stderr, "Warning: %s does not parse as a JPEG, sending unaligned\n", file);
+    }
+    image->region_hashes = (uint64_t*)malloc(sizeof(uint64_t) * frame_region_count(image->size));
+    if (!image->region_hashes) {
+        free_jpeg_layout(&image->layout);
+        free(image->data);
+        return -1;
+    }
+
+    printf("Image: %s (%zu bytes)\n", file, image->size);
+    if (image->layout.interval_count > 0) {
+        printf("Restart intervals: %d (%u MCUs each), packets aligned to intervals\n",
+               image->layout.interval_count, image->layout.restart_interval);
+    } else if (image->layout.base_end > 0) {
+        printf("Progressive: %d scans, base scans 1-%d (%zu of %zu bytes) sent redundantly\n",
+               image->layout.scan_count, image->layout.base_scans, image->layout.base_end,
+               image->size);
+    } else {
+        printf("No restart intervals, partial frames cannot be concealed per interval\n");
+    }
+    return 0;
+}
+
 
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        fprintf(stderr, "Usage: %s <client_ip> <port> <image_file>\n", argv[0]);
+    buffer_config_t buffer_config;
+    init_buffer_config(&buffer_config);
+    argc = buffer_config_parse(&buffer_config, argc, argv);
+
+    // A same-host client is reached through shm:<name> instead of an address and port
+    int local = argc >= 3 && strncmp(argv[1], SHM_PREFIX, strlen(SHM_PREFIX)) == 0;
+    int first_image = local ? 2 : 3;
+    if (argc <= first_image || argc - first_image > MAX_IMAGES) {
+        fprintf(stderr, "Usage: %s <client_ip> <port> <image_file> [image_file...]\n", argv[0]);
+        fprintf(stderr, "       %s shm:<name> <image_file> [image_file...]\n", argv[0]);
+        fprintf(stderr, "Options: --bitrate-kbps N --rtt-ms N --max-frame-bytes N (buffer sizing)\n");
+        fprintf(stderr, "         --hugepages off|transparent|explicit --lock-memory (buffer memory)\n");
         return 1;
     }
     
     const char *client_ip = argv[1];
-    int port = atoi(argv[2]);
-    const char *image_file = argv[3];
+    int port = local ? 0 : atoi(argv[2]);
     
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-        perror("Socket creation failed");
+    transport_t transport;
+    if (transport_open_sender(&transport, client_ip, port) < 0) {
         return 1;
     }
-    
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 1000;  
-    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    
-    struct sockaddr_in client_addr;
-    memset(&client_addr, 0, sizeof(client_addr));
-    client_addr.sin_family = AF_INET;
-    client_addr.sin_port = htons(port);
-    client_addr.sin_addr.s_addr = inet_addr(client_ip);
-    
-    size_t image_size;
-    uint8_t *image_data = read_image_file(image_file, &image_size);
-    if (!image_data) {
-        close(sockfd);
+    if (trace_open("server") < 0) {
+        transport_close(&transport);
         return 1;
     }
+
+    // No SA_RESTART so a pacing sleep returns and the trace gets written
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
     
+    sender_t sender;
+    memset(&sender, 0, sizeof(sender));
+    sender.transport = &transport;
+    sender.ssrc = 0x12345678;
+
+    static srtp_t srtp;
+    int keyed = srtp_init_from_env(&srtp);
+    if (keyed < 0) {
+        transport_close(&transport);
+        return 1;
+    }
+    if (keyed) {
+        // The IV covers the SSRC, so a restarted server reusing the key and
+        // sequence numbers still never repeats an IV
+        if (random_ssrc(&sender.ssrc) < 0) {
+            transport_close(&transport);
+            return 1;
+        }
+        sender.srtp = &srtp;
+    }
+
     printf("Enhanced RTP Server with Retransmission\n");
-    printf("Image: %s (%zu bytes)\n", image_file, image_size);
-    printf("Sending to %s:%d\n\n", client_ip, port);
-    
-    memset(packet_storage, 0, sizeof(packet_storage));
-    
+
+    // Frames cycle through the given images, standing in for a camera feed
+    static image_t images[MAX_IMAGES];
+    int image_count = argc - first_image;
+    for (int i = 0; i < image_count; i++) {
+        if (load_image(&images[i], argv[first_image + i]) < 0) {
+            transport_close(&transport);
+            return 1;
+        }
+    }
+
+    // Storage must hold the largest frame it will send twice over
+    for (int i = 0; i < image_count; i++) {
+        if (images[i].size > buffer_config.max_frame_size) {
+            buffer_config.max_frame_size = images[i].size;
+        }
+    }
+    buffer_config_size(&buffer_config);
+
+    // Probed before the storage is set up, so its slots are sized for the
+    // datagrams actually sent
+    probe_datagram_size(&sender);
+    if (init_packet_store(buffer_config.stored_packets, session_datagram_size(&sender),
+                          &buffer_config) < 0) {
+        transport_close(&transport);
+        return 1;
+    }
+    printf("Retransmission storage: %d packets (%u kbps, %u ms RTT, %zu-byte frames)\n",
+           buffer_config.stored_packets, buffer_config.bitrate_kbps, buffer_config.rtt_ms,
+           buffer_config.max_frame_size);
+
+    if (local) {
+        printf("Sending through shared-memory ring %s\n\n", client_ip);
+    } else {
+        printf("Sending to %s:%d\n\n", client_ip, port);
+    }
     
-    uint32_t ssrc = 0x12345678;
-    uint16_t sequence = 0;
+    if (init_dedup(buffer_config.max_frame_size) < 0) {
+        free_packet_store();
+        transport_close(&transport);
+        return 1;
+    }
 
-    while (1) {
-        printf("Sending image...\n");
-        size_t offset = 0;
-        int packets_sent = 0;
-        int retransmissions = 0;
-      
+    for (int frame = 0; running; frame++) {
+        image_t *image = &images[frame % image_count];
+
+        if (sender.datagram_size == 0 || sender.reprobe) {
+            probe_datagram_size(&sender);
+        }
+
+        sender.packets_sent = 0;
+        sender.redundant_packets = 0;
+        sender.bytes_sent = 0;
+        memset(&sender.rstats, 0, sizeof(sender.rstats));
 
         uint32_t timestamp = get_timestamp_ms();
 
-        while (offset < image_size) {
-            rtp_packet_t packet;
-            size_t chunk_size = (image_size - offset > CHUNK_SIZE) ? 
-                                CHUNK_SIZE : (image_size - offset);
-        
-            int packet_size = create_rtp_packet(&packet, sequence, timestamp,
-                                               ssrc, image_data + offset, chunk_size);
-        
-  
-            if (offset + chunk_size >= image_size) {
-                packet.header.marker = 1;
-                printf("Packet %d (seq=%u): %zu bytes [LAST PACKET]\n", 
-                       packets_sent, sequence, chunk_size);
-            } else if (packets_sent % 10 == 0) {
-                printf("Packet %d (seq=%u): %zu bytes\n", 
-                       packets_sent, sequence, chunk_size);
-            }
-        
+        // Hashed every frame as a live feed would be; the hash table keeps
+        // this frame's regions so a later ack can make it the reference
+        uint64_t hash_start_us = trace_now_us();
+        uint64_t hash = frame_hash(image->data, image->size, image->region_hashes);
+        trace_span("hash", timestamp, hash_start_us, image->size);
 
-            sendto(sockfd, &packet, packet_size, 0,
-                   (struct sockaddr*)&client_addr, sizeof(client_addr));
-        
-            store_packet(&packet, packet_size, sequence);
-        
-            offset += chunk_size;
-            sequence++;
-            packets_sent++;
-        
-            usleep(WAIT_NACK_MS); 
-        
-            nack_packet_t nack;
-            struct sockaddr_in nack_addr;
-            socklen_t nack_addr_len = sizeof(nack_addr);
-        
-            ssize_t nack_len = recvfrom(sockfd, &nack, sizeof(nack), 0,
-                                        (struct sockaddr*)&nack_addr, &nack_addr_len);
-        
-            if (nack_len > 0 && nack.type == PACKET_TYPE_NACK) {
-                uint16_t missing_seq = ntohs(nack.seq_start);
-                printf("\nReceived NACK for seq=%u, retransmitting...\n", missing_seq);
-            
-                stored_packet_t *stored = get_stored_packet(missing_seq);
-                if (stored) {
-                    sendto(sockfd, &stored->packet, stored->size, 0,
-                           (struct sockaddr*)&client_addr, sizeof(client_addr));
-                    retransmissions++;
-                    printf("Retransmitted packet seq=%u\n\n", missing_seq);
-                } else {
-                    printf("Warning: Requested packet seq=%u not in storage\n\n", missing_seq);
-                }
-            }
+        uint64_t crc_start_us = trace_now_us();
+        sender.frame_crc = crc32c(0, image->data, image->size);
+        trace_span("crc", timestamp, crc_start_us, image->size);
+        region_cache_put(&dedup.sent_frames, hash, image->size, image->region_hashes,
+                         frame_region_count(image->size));
+
+        uint64_t send_start_us = trace_now_us();
+        size_t delta_length = 0;
+        if (dedup.have_reference && dedup.reference_hash == hash) {
+            printf("Sending image %s as a repeat of the acknowledged frame...\n", image->file);
+            send_repeat_frame(&sender, image, timestamp);
+        } else if (dedup.have_reference &&
+                   (delta_length = changed_bytes(image)) > 0 &&
+                   delta_length * 100 <= image->size * DELTA_MAX_CHANGED_PCT) {
+            printf("Sending image %s as a delta (%zu of %zu bytes changed)...\n",
+                   image->file, delta_length, image->size);
+            send_delta_frame(&sender, image, delta_length, timestamp);
+        } else {
+            printf("Sending image %s...\n", image->file);
+            send_full_frame(&sender, image, timestamp);
         }
     
+        trace_span("send", timestamp, send_start_us, sender.bytes_sent);
+
         printf("\nWaiting for retransmission requests...\n");
-        usleep(WAIT_NACK_MS);
+        uint64_t wait_start_us = trace_now_us();
+        if (local) {
+            // The ring does not lose packets on its own, so the gap mainly lets the client's
+            // jitter buffer drain before the next frame
+            struct timeval gap_start, now;
+            get_monotonic_time(&gap_start);
+            do {
+                collect_nacks(&transport, 1, sender.sequence - 1, &sender.rstats);
+                serve_nacks(&transport, &sender.rstats);
+                get_monotonic_time(&now);
+            } while (time_diff_ms(&gap_start, &now) < LOCAL_FRAME_GAP_MS);
+        } else {
+            usleep(WAIT_NACK_MS);
     
-        for (int i = 0; i < 10; i++) {
-            nack_packet_t nack;
-            struct sockaddr_in nack_addr;
-            socklen_t nack_addr_len = sizeof(nack_addr);
-        
-            ssize_t nack_len = recvfrom(sockfd, &nack, sizeof(nack), 0,
-                                        (struct sockaddr*)&nack_addr, &nack_addr_len);
-        
-            if (nack_len > 0 && nack.type == PACKET_TYPE_NACK) {
-                uint16_t missing_seq = ntohs(nack.seq_start);
-                printf("Final NACK for seq=%u\n", missing_seq);
+            for (int i = 0; i < 10; i++) {
+                collect_nacks(&transport, 1, sender.sequence - 1, &sender.rstats);
+                serve_nacks(&transport, &sender.rstats);
             
-                stored_packet_t *stored = get_stored_packet(missing_seq);
-                if (stored) {
-                    sendto(sockfd, &stored->packet, stored->size, 0,
-                           (struct sockaddr*)&client_addr, sizeof(client_addr));
-                    retransmissions++;
-                }
+                usleep(GAP_WAIT_NACK_MS); 
             }
-        
-            usleep(GAP_WAIT_NACK_MS); 
         }
+        trace_span("nack_wait", timestamp, wait_start_us, sender.rstats.retransmissions);
         printf("\n=== Transmission Complete ===\n");
-        printf("Packets sent: %d\n", packets_sent);
-        printf("Retransmissions: %d\n", retransmissions);
+        printf("Packets sent: %d (%zu bytes)\n", sender.packets_sent, sender.bytes_sent);
+        if (sender.redundant_packets > 0) {
+            printf("Redundant base-scan packets: %d\n", sender.redundant_packets);
+        }
+        printf("Retransmissions: %d\n", sender.rstats.retransmissions);
+        printf("Stale NACKs dropped: %d (%zu bytes not resent)\n",
+               sender.rstats.stale_nacks_dropped, sender.rstats.bytes_saved);
+        if (sender.rstats.skips > 0) {
+            printf("Client catch-up requests: %d\n", sender.rstats.skips);
+        }
+        printf("Packet storage: %zu packets (resized %d times)\n",
+               packet_store.capacity, packet_store.resizes);
+        print_arena(&packet_store.arena, "Packet storage");
     }
     
-    free(image_data);
-    close(sockfd);
+    for (int i = 0; i < image_count; i++) {
+        free_jpeg_layout(&images[i].layout);
+        free(images[i].region_hashes);
+        free(images[i].data);
+    }
+    free_dedup();
+    free_packet_store();
+    trace_close();
+    transport_close(&transport);
     return 0;
 }
\ No newline at end of file
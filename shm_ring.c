@@ -0,0 +1,115 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+#include "shm_ring.h"
+
+#define SLOT_HEADER sizeof(uint32_t)
+
+static uint8_t* slot_at(shm_ring_t *ring, uint32_t index) {
+    return ring->slots + (size_t)(index % ring->slot_count) * (SLOT_HEADER + ring->slot_size);
+}
+
+// The mapping is shared between processes, so no FUTEX_PRIVATE_FLAG
+static int futex_wait(uint32_t *addr, uint32_t expected, int timeout_ms) {
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    return (int)syscall(SYS_futex, addr, FUTEX_WAIT, expected, &timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+static void bump_and_wake(uint32_t *futex_word, uint32_t *waiting) {
+    __atomic_add_fetch(futex_word, 1, __ATOMIC_RELEASE);
+    if (__atomic_load_n(waiting, __ATOMIC_ACQUIRE)) {
+        futex_wake(futex_word);
+    }
+}
+
+size_t shm_ring_bytes(uint32_t slot_size, uint32_t slot_count) {
+    return sizeof(shm_ring_t) + (size_t)slot_count * (SLOT_HEADER + slot_size);
+}
+
+void shm_ring_init(shm_ring_t *ring, uint32_t slot_size, uint32_t slot_count) {
+    memset(ring, 0, sizeof(shm_ring_t));
+    ring->slot_size = slot_size;
+    ring->slot_count = slot_count;
+}
+
+// Waits until `ready` holds, sleeping on futex_word in between. The waiting
+// flag is raised before the final check so a wakeup cannot be missed.
+static int wait_for(shm_ring_t *ring, int (*ready)(shm_ring_t*), uint32_t *futex_word,
+                    uint32_t *waiting, int timeout_ms) {
+    if (ready(ring)) return 1;
+    if (timeout_ms <= 0) return 0;
+
+    uint32_t seen = __atomic_load_n(futex_word, __ATOMIC_ACQUIRE);
+    __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+    int result = ready(ring);
+    if (!result) {
+        if (futex_wait(futex_word, seen, timeout_ms) < 0 && errno == EINTR) {
+            __atomic_store_n(waiting, 0, __ATOMIC_RELEASE);
+            return -1;
+        }
+        result = ready(ring);
+    }
+    __atomic_store_n(waiting, 0, __ATOMIC_RELEASE);
+    return result;
+}
+
+static int has_space(shm_ring_t *ring) {
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return ring->head - tail < ring->slot_count;
+}
+
+static int has_data(shm_ring_t *ring) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    return head != ring->tail;
+}
+
+int shm_ring_push(shm_ring_t *ring, const void *data, size_t len, int timeout_ms) {
+    if (len > ring->slot_size) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (wait_for(ring, has_space, &ring->space_futex, &ring->producer_waiting, timeout_ms) <= 0) {
+        ring->dropped++;
+        errno = EAGAIN;
+        return -1;
+    }
+
+    uint8_t *slot = slot_at(ring, ring->head);
+    uint32_t slot_len = (uint32_t)len;
+    memcpy(slot, &slot_len, SLOT_HEADER);
+    memcpy(slot + SLOT_HEADER, data, len);
+
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    bump_and_wake(&ring->data_futex, &ring->consumer_waiting);
+    return 0;
+}
+
+ssize_t shm_ring_pop(shm_ring_t *ring, void *buf, size_t cap, int timeout_ms) {
+    int ready = wait_for(ring, has_data, &ring->data_futex, &ring->consumer_waiting, timeout_ms);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    uint8_t *slot = slot_at(ring, ring->tail);
+    uint32_t slot_len;
+    memcpy(&slot_len, slot, SLOT_HEADER);
+    size_t copy = slot_len < cap ? slot_len : cap;
+    memcpy(buf, slot + SLOT_HEADER, copy);
+
+    __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    bump_and_wake(&ring->space_futex, &ring->producer_waiting);
+    return (ssize_t)copy;
+}
@@ -0,0 +1,38 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Single-producer single-consumer ring of datagram slots living in shared
+// memory. Each side only writes its own index; a waiting side sleeps on a
+// futex that the other side bumps when it makes progress, so an idle ring
+// costs no syscalls and a busy one costs none either.
+typedef struct {
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint32_t head;              // next slot the producer fills
+    uint32_t tail;              // next slot the consumer drains
+    uint32_t data_futex;        // bumped when a slot is filled
+    uint32_t space_futex;       // bumped when a slot is drained
+    uint32_t consumer_waiting;
+    uint32_t producer_waiting;
+    uint64_t dropped;           // pushes that timed out on a full ring
+    uint8_t slots[];            // slot_count * (4-byte length + slot_size)
+} shm_ring_t;
+
+size_t shm_ring_bytes(uint32_t slot_size, uint32_t slot_count);
+void shm_ring_init(shm_ring_t *ring, uint32_t slot_size, uint32_t slot_count);
+
+// Copies a datagram into the next slot, waiting up to timeout_ms for space.
+// Returns 0, or -1 if the datagram is larger than a slot (EMSGSIZE) or the
+// ring stayed full (EAGAIN, counted in dropped) like a full socket buffer.
+int shm_ring_push(shm_ring_t *ring, const void *data, size_t len, int timeout_ms);
+
+// Copies the oldest datagram out, waiting up to timeout_ms for one.
+// Returns its length, 0 on timeout, -1 if interrupted by a signal.
+// Datagrams larger than cap are truncated as recvfrom would.
+ssize_t shm_ring_pop(shm_ring_t *ring, void *buf, size_t cap, int timeout_ms);
+
+#endif // SHM_RING_H
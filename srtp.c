@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "srtp.h"
+
+#define SRTP_LABEL_ENCRYPTION 0x00
+#define SRTP_LABEL_SALT 0x02
+
+// RFC 3711 section 4.3 with a key derivation rate of 0: AES-CM keyed with
+// the master key over the master salt XOR the label, zero-padded to the
+// 112-bit PRF input, with a 16-bit block counter
+static void derive_key(const aes_gcm_t *prf, const uint8_t master_salt[SRTP_MASTER_SALT_SIZE],
+                       uint8_t label, uint8_t *out, size_t len) {
+    uint8_t input[AES_BLOCK_SIZE] = {0};
+    memcpy(input, master_salt, SRTP_MASTER_SALT_SIZE);
+    input[7] ^= label;
+
+    for (uint16_t block = 0; len > 0; block++) {
+        uint8_t keystream[AES_BLOCK_SIZE];
+        input[14] = (uint8_t)(block >> 8);
+        input[15] = (uint8_t)block;
+        aes_encrypt_block(prf, input, keystream);
+        size_t n = len < AES_BLOCK_SIZE ? len : AES_BLOCK_SIZE;
+        memcpy(out, keystream, n);
+        out += n;
+        len -= n;
+    }
+}
+
+void srtp_init(srtp_t *srtp, const uint8_t master_key[SRTP_MASTER_KEY_SIZE],
+               const uint8_t master_salt[SRTP_MASTER_SALT_SIZE], int allow_hardware) {
+    aes_gcm_t prf;
+    aes_gcm_init(&prf, master_key, 0);
+    uint8_t session_key[AES_KEY_SIZE];
+    uint8_t session_salt[SRTP_MASTER_SALT_SIZE];
+    derive_key(&prf, master_salt, SRTP_LABEL_ENCRYPTION, session_key, sizeof(session_key));
+    derive_key(&prf, master_salt, SRTP_LABEL_SALT, session_salt, sizeof(session_salt));
+
+    srtp_init_session(srtp, session_key, session_salt, allow_hardware);
+    memset(session_key, 0, sizeof(session_key));
+    memset(session_salt, 0, sizeof(session_salt));
+    memset(&prf, 0, sizeof(prf));
+}
+
+void srtp_init_session(srtp_t *srtp, const uint8_t session_key[AES_KEY_SIZE],
+                       const uint8_t session_salt[SRTP_MASTER_SALT_SIZE], int allow_hardware) {
+    memset(srtp, 0, sizeof(srtp_t));
+    memcpy(srtp->salt, session_salt, sizeof(srtp->salt));
+    aes_gcm_init(&srtp->gcm, session_key, allow_hardware);
+}
+
+static int parse_hex(const char *hex, uint8_t *out, size_t len) {
+    if (strlen(hex) != 2 * len) {
+        return -1;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char digits[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        char *end;
+        out[i] = (uint8_t)strtoul(digits, &end, 16);
+        if (*end != '\0') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int srtp_init_from_env(srtp_t *srtp) {
+    const char *hex = getenv(SRTP_KEY_ENV);
+    if (!hex || hex[0] == '\0') {
+        return 0;
+    }
+
+    uint8_t master[SRTP_MASTER_KEY_SIZE + SRTP_MASTER_SALT_SIZE];
+    if (parse_hex(hex, master, sizeof(master)) < 0) {
+        fprintf(stderr, "%s must be %zu hex digits (master key then master salt)\n",
+                SRTP_KEY_ENV, 2 * sizeof(master));
+        return -1;
+    }
+    srtp_init(srtp, master, master + SRTP_MASTER_KEY_SIZE, 1);
+    memset(master, 0, sizeof(master));
+    printf("SRTP: AEAD_AES_128_GCM using %s\n", aes_gcm_implementation(&srtp->gcm));
+    return 1;
+}
+
+// RFC 7714 section 8.1: 00 00 || SSRC || ROC || SEQ, XOR the session salt
+static void build_iv(srtp_t *srtp, rtp_packet_t *packet, uint64_t seq, uint8_t iv[AES_GCM_IV_SIZE]) {
+    uint32_t roc = htonl((uint32_t)(seq >> 16));
+    uint16_t seq16 = htons((uint16_t)seq);
+    memset(iv, 0, AES_GCM_IV_SIZE);
+    memcpy(iv + 2, &packet->header.ssrc, sizeof(packet->header.ssrc));
+    memcpy(iv + 6, &roc, sizeof(roc));
+    memcpy(iv + 10, &seq16, sizeof(seq16));
+    for (int i = 0; i < AES_GCM_IV_SIZE; i++) {
+        iv[i] ^= srtp->salt[i];
+    }
+}
+
+// Bytes authenticated but not encrypted: the fixed header, CSRCs and any
+// header extension (so the frame CRC stays readable to the receiver)
+static int header_length(rtp_packet_t *packet, size_t len) {
+    uint32_t frame_crc;
+    int has_crc;
+    int extension_size = parse_rtp_extension(packet, len - sizeof(rtp_header_t), &frame_crc, &has_crc);
+    return extension_size < 0 ? -1 : (int)sizeof(rtp_header_t) + extension_size;
+}
+
+int srtp_protect(srtp_t *srtp, rtp_packet_t *packet, size_t len, uint64_t seq) {
+    int header_len = header_length(packet, len);
+    if (header_len < 0 || len + SRTP_TAG_SIZE > MAX_UDP_PAYLOAD) {
+        return -1;
+    }
+
+    uint8_t iv[AES_GCM_IV_SIZE];
+    build_iv(srtp, packet, seq, iv);
+    uint8_t *bytes = (uint8_t*)packet;
+    aes_gcm_encrypt(&srtp->gcm, iv, bytes, header_len, bytes + header_len, len - header_len,
+                    bytes + len);
+    return (int)(len + SRTP_TAG_SIZE);
+}
+
+// 0 if seq may be accepted, else the SRTP_ERR_ code to reject it with
+static int replay_check(srtp_t *srtp, uint64_t seq) {
+    if (!srtp->replay_initialized || seq > srtp->replay_top) {
+        return 0;
+    }
+    if (srtp->replay_top - seq >= SRTP_REPLAY_WINDOW) {
+        return SRTP_ERR_REPLAY;
+    }
+    size_t bit = seq % SRTP_REPLAY_WINDOW;
+    return (srtp->replay_window[bit / 64] >> (bit % 64)) & 1 ? SRTP_ERR_DUPLICATE : 0;
+}
+
+static void replay_accept(srtp_t *srtp, uint64_t seq) {
+    if (!srtp->replay_initialized) {
+        memset(srtp->replay_window, 0, sizeof(srtp->replay_window));
+        srtp->replay_top = seq;
+        srtp->replay_initialized = 1;
+    } else if (seq > srtp->replay_top) {
+        // Slide forward, forgetting the sequences that left the window
+        if (seq - srtp->replay_top >= SRTP_REPLAY_WINDOW) {
+            memset(srtp->replay_window, 0, sizeof(srtp->replay_window));
+        } else {
+            for (uint64_t s = srtp->replay_top + 1; s < seq; s++) {
+                size_t bit = s % SRTP_REPLAY_WINDOW;
+                srtp->replay_window[bit / 64] &= ~(1ULL << (bit % 64));
+            }
+        }
+        srtp->replay_top = seq;
+    }
+    size_t bit = seq % SRTP_REPLAY_WINDOW;
+    srtp->replay_window[bit / 64] |= 1ULL << (bit % 64);
+}
+
+int srtp_unprotect(srtp_t *srtp, rtp_packet_t *packet, size_t len, uint64_t seq) {
+    if (len < sizeof(rtp_header_t) + SRTP_TAG_SIZE) {
+        return SRTP_ERR_AUTH;
+    }
+    int replay = replay_check(srtp, seq);
+    if (replay < 0) {
+        return replay;
+    }
+
+    size_t protected_len = len - SRTP_TAG_SIZE;
+    int header_len = header_length(packet, protected_len);
+    if (header_len < 0) {
+        return SRTP_ERR_AUTH;
+    }
+
+    uint8_t iv[AES_GCM_IV_SIZE];
+    build_iv(srtp, packet, seq, iv);
+    uint8_t *bytes = (uint8_t*)packet;
+    if (aes_gcm_decrypt(&srtp->gcm, iv, bytes, header_len, bytes + header_len,
+                        protected_len - header_len, bytes + protected_len) < 0) {
+        return SRTP_ERR_AUTH;
+    }
+
+    // Only authenticated packets move the window, so forgeries cannot shift it
+    replay_accept(srtp, seq);
+    return (int)protected_len;
+}
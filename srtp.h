@@ -0,0 +1,58 @@
+#ifndef SRTP_H
+#define SRTP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "rtp.h"
+#include "aes_gcm.h"
+
+#define SRTP_MASTER_KEY_SIZE 16
+#define SRTP_MASTER_SALT_SIZE 12
+#define SRTP_TAG_SIZE AES_GCM_TAG_SIZE
+#define SRTP_REPLAY_WINDOW 4096     // packets; must cover NACK retransmissions
+#define SRTP_KEY_ENV "RTP_SRTP_KEY" // hex master key then master salt
+
+#define SRTP_ERR_AUTH -1
+#define SRTP_ERR_REPLAY -2
+#define SRTP_ERR_DUPLICATE -3
+
+// AEAD_AES_128_GCM protection of RTP packets in the style of RFC 7714:
+// session key and salt derived from a master key and salt with the RFC 3711
+// AES-CM key derivation, a per-packet IV from SSRC, rollover counter and
+// sequence number, the RTP header (with any extension) authenticated and
+// the payload encrypted in place with the tag appended. The receiver keeps
+// a sliding replay window over extended sequence numbers. The header
+// extension, and with it the frame CRC, stays readable on the wire.
+typedef struct {
+    aes_gcm_t gcm;
+    uint8_t salt[SRTP_MASTER_SALT_SIZE];    // session salt
+    int replay_initialized;
+    uint64_t replay_top;                    // highest authenticated sequence
+    uint64_t replay_window[SRTP_REPLAY_WINDOW / 64];
+} srtp_t;
+
+void srtp_init(srtp_t *srtp, const uint8_t master_key[SRTP_MASTER_KEY_SIZE],
+               const uint8_t master_salt[SRTP_MASTER_SALT_SIZE], int allow_hardware);
+
+// Skips the key derivation: RFC 7714's test vectors give the session key
+// and salt themselves
+void srtp_init_session(srtp_t *srtp, const uint8_t session_key[AES_KEY_SIZE],
+                       const uint8_t session_salt[SRTP_MASTER_SALT_SIZE], int allow_hardware);
+
+// Keys from SRTP_KEY_ENV when it is set. Returns 1 when keyed, 0 when the
+// variable is unset (streams stay in the clear), -1 if it is malformed.
+int srtp_init_from_env(srtp_t *srtp);
+
+// Encrypts the payload of a built packet in place and appends the tag.
+// seq is the extended sequence number. Returns the new packet size, or -1
+// if the tag would not fit the datagram.
+int srtp_protect(srtp_t *srtp, rtp_packet_t *packet, size_t len, uint64_t seq);
+
+// Authenticates and decrypts in place. Returns the plaintext packet size,
+// SRTP_ERR_AUTH if the packet is malformed or forged, SRTP_ERR_DUPLICATE if
+// the sequence was already accepted (a redundant copy or a retransmission
+// that crossed the original), or SRTP_ERR_REPLAY if it is behind the
+// replay window.
+int srtp_unprotect(srtp_t *srtp, rtp_packet_t *packet, size_t len, uint64_t seq);
+
+#endif // SRTP_H
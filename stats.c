@@ -16,13 +16,13 @@ void init_stats(stats_t *stats) {
     get_monotonic_time(&stats->start_time);
 }
 
-void update_stats(stats_t *stats, uint16_t seq, size_t bytes) {
-    uint16_t expected_seq = stats->last_seq + 1;
+void update_stats(stats_t *stats, uint64_t seq, size_t bytes) {
+    uint64_t expected_seq = stats->last_seq + 1;
     
-    if (stats->packets_received > 0 && seq != expected_seq) {
-        uint16_t lost = seq - expected_seq;
+    if (stats->packets_received > 0 && seq > expected_seq) {
+        uint64_t lost = seq - expected_seq;
         stats->packets_lost += lost;
-        printf("Warning: Packet loss detected! Expected seq %u, got %u (lost %u)\n",
+        printf("Warning: Packet loss detected! Expected seq %" PRIu64 ", got %" PRIu64 " (lost %" PRIu64 ")\n",
                expected_seq, seq, lost);
     }
     
@@ -31,6 +31,21 @@ void update_stats(stats_t *stats, uint16_t seq, size_t bytes) {
     stats->last_seq = seq;
 }
 
+// The server stamps frames with its CLOCK_MONOTONIC in ms, so this is only
+// meaningful when both ends share a clock (same host or link emulator)
+void update_frame_latency(stats_t *stats, uint32_t rtp_timestamp) {
+    struct timeval now;
+    get_monotonic_time(&now);
+
+    uint32_t now_ms = (uint32_t)((now.tv_sec * 1000) + (now.tv_usec / 1000));
+    uint32_t latency = now_ms - rtp_timestamp;
+
+    stats->frame_latency_sum_ms += latency;
+    if (latency > stats->frame_latency_max_ms) {
+        stats->frame_latency_max_ms = latency;
+    }
+}
+
 void print_stats(stats_t *stats) {
     struct timeval now;
     get_monotonic_time(&now);
@@ -39,12 +54,35 @@ void print_stats(stats_t *stats) {
     double elapsed_s = elapsed_ms / 1000.0; 
 
     printf("\n=== Statistics ===\n");
-    printf("Packets received: %u\n", stats->packets_received);
-    printf("Packets lost: %u\n", stats->packets_lost);
-    printf("Frames received: %u\n", stats->frames_received);
-    printf("Total bytes Read: %u\n", stats->total_bytes);
-    printf("Retransmit requests: %u\n", stats->retransmit_requests);
-    printf("Packets Reordered: %u\n", stats->packets_reordered);
+    printf("Packets received: %" PRIu64 "\n", stats->packets_received);
+    printf("Packets lost: %" PRIu64 "\n", stats->packets_lost);
+    printf("Frames received: %" PRIu64 "\n", stats->frames_received);
+    printf("Frames concealed: %" PRIu64 " (%" PRIu64 " restart intervals)\n",
+           stats->frames_concealed, stats->intervals_concealed);
+    printf("Frames from base scans only: %" PRIu64 "\n", stats->frames_base_only);
+    printf("Frames failing checksum: %" PRIu64 "\n", stats->frames_corrupt);
+    printf("Frames skipped to catch up: %" PRIu64 " (%" PRIu64 " times)\n",
+           stats->frames_skipped, stats->catch_ups);
+    printf("Frames repeated from cache: %" PRIu64 ", delta frames: %" PRIu64 " (%" PRIu64 " reference misses)\n",
+           stats->frames_repeated, stats->frames_delta, stats->reference_misses);
+    printf("Total bytes Read: %" PRIu64 "\n", stats->total_bytes);
+    printf("Largest datagram: %u bytes\n", stats->max_datagram_size);
+    printf("Retransmit requests: %" PRIu64 "\n", stats->retransmit_requests);
+    printf("NACK retries: %" PRIu64 "\n", stats->nack_retries);
+    printf("SRTP packets rejected: %" PRIu64 " failed authentication, %" PRIu64 " replayed\n",
+           stats->srtp_auth_failures, stats->srtp_replayed);
+    printf("SRTP duplicates dropped: %" PRIu64 "\n", stats->srtp_duplicates);
+    if (stats->packets_received > 0) {
+        printf("NACKs suppressed past deadline: %" PRIu64 " (~%" PRIu64 " bytes of retransmission saved)\n",
+               stats->nacks_suppressed,
+               stats->nacks_suppressed * (stats->total_bytes / stats->packets_received));
+    }
+    printf("Packets Reordered: %" PRIu64 "\n", stats->packets_reordered);
+    printf("Packets recovered: %" PRIu64 "\n", stats->packets_recovered);
+    printf("Buffer resizes: %" PRIu64 " (playout %u, NACK %u packets, frame %" PRIu64 " bytes)\n",
+           stats->buffer_resizes, stats->playout_capacity, stats->nack_capacity, stats->frame_capacity);
+    printf("Buffer arena: %.1f of %.1f MB used, %u heap fallbacks\n",
+           stats->arena_used / 1048576.0, stats->arena_size / 1048576.0, stats->arena_fallbacks);
     printf("Elapsed time: %.2f seconds\n", elapsed_s);
     
     if (elapsed_ms > 0) {
@@ -53,5 +91,10 @@ void print_stats(stats_t *stats) {
         printf("Average frame rate: %.2f fps\n",
                 (stats->frames_received / elapsed_ms) * 1000.0);
     }
+    if (stats->frames_received > 0) {
+        printf("Average frame latency: %.2f ms\n",
+                (double)stats->frame_latency_sum_ms / stats->frames_received);
+        printf("Max frame latency: %u ms\n", stats->frame_latency_max_ms);
+    }
     printf("==================\n");
 }
\ No newline at end of file
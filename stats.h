@@ -9,20 +9,50 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <errno.h>
+#include <stdint.h>
+#include <inttypes.h>
 
+// 64-bit counters: at multi-gigabit rates 32-bit byte and packet counts
+// overflow within seconds to minutes
 typedef struct {
-    uint32_t packets_received;
-    uint32_t packets_lost;
-    uint32_t frames_received;
-    uint16_t last_seq;
-    uint32_t total_bytes;
-    uint32_t retransmit_requests;
-    uint32_t packets_reordered;
+    uint64_t packets_received;
+    uint64_t packets_lost;
+    uint64_t frames_received;
+    uint64_t frames_concealed;
+    uint64_t frames_base_only;      // progressive frames delivered without their refinement scans
+    uint64_t intervals_concealed;
+    uint64_t frames_corrupt;        // complete frames that failed the frame CRC
+    uint64_t frames_skipped;        // stale frames dropped to catch up
+    uint64_t catch_ups;
+    uint64_t frames_repeated;       // served from the frame cache without any data
+    uint64_t frames_delta;          // rebuilt from a cached frame plus changed regions
+    uint64_t reference_misses;      // repeat/delta frames whose reference was not cached
+    uint64_t last_seq;              // extended sequence number
+    uint64_t total_bytes;
+    uint64_t retransmit_requests;
+    uint64_t nack_retries;          // NACKs sent again, a round trip after one went unanswered
+    uint64_t nacks_suppressed;
+    uint64_t srtp_auth_failures;    // dropped: forged, corrupted or keyed differently
+    uint64_t srtp_replayed;         // dropped: behind the replay window
+    uint64_t srtp_duplicates;       // dropped: already accepted, e.g. a redundant base copy
+    uint64_t packets_reordered;
+    uint64_t packets_recovered;
+    uint32_t max_datagram_size;     // largest RTP datagram, shows the negotiated size
+    uint64_t frame_latency_sum_ms;
+    uint32_t frame_latency_max_ms;
+    uint64_t buffer_resizes;        // runtime growth of any receive buffer
+    uint32_t playout_capacity;      // current capacities, packets
+    uint32_t nack_capacity;
+    uint64_t frame_capacity;        // bytes
+    uint64_t arena_used;            // bytes of the buffer arena carved so far
+    uint64_t arena_size;
+    uint32_t arena_fallbacks;       // buffer allocations that did not fit it
     struct timeval start_time;
 } stats_t;
 
 void init_stats(stats_t *stats);
-void update_stats(stats_t *stats, uint16_t seq, size_t bytes);
+void update_stats(stats_t *stats, uint64_t seq, size_t bytes);
+void update_frame_latency(stats_t *stats, uint32_t rtp_timestamp);
 void print_stats(stats_t *stats);
 
 #endif // STATS_H
\ No newline at end of file
@@ -5,7 +5,18 @@
 #include <string.h>
 #include <sys/time.h> 
 
+static struct timeval *virtual_time = NULL;
+
+void set_virtual_time(struct timeval *tv) {
+    virtual_time = tv;
+}
+
 void get_monotonic_time(struct timeval *tv) {
+    if (virtual_time) {
+        *tv = *virtual_time;
+        return;
+    }
+
     struct timespec ts;
     clock_gettime(CLOCK_MONOTONIC, &ts);
 
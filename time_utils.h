@@ -6,6 +6,10 @@
 
 void get_monotonic_time(struct timeval *tv);
 
+// Point get_monotonic_time at a caller-owned clock (NULL restores the real
+// one). Replay uses this to run recorded traffic faster than real time.
+void set_virtual_time(struct timeval *tv);
+
 long time_diff_ms(struct timeval *start, struct timeval *end);
 
 #endif // TIME_UTILS_H
\ No newline at end of file
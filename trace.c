@@ -0,0 +1,195 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <inttypes.h>
+#include "trace.h"
+#include "time_utils.h"
+
+typedef struct {
+    uint64_t time_us;
+    uint64_t duration_us;   // 0 for instants
+    const char *name;
+    uint64_t arg;
+    uint32_t frame;         // RTP timestamp
+    char phase;             // 'b' frame span, 'X' packet span, 'n' instant
+} trace_event_t;
+
+// Written only by its thread; the exporter reads it after the threads are done
+typedef struct trace_ring {
+    trace_event_t events[TRACE_RING_SIZE];
+    uint64_t count;         // total recorded, so count - TRACE_RING_SIZE were overwritten
+    long tid;
+    struct trace_ring *next;
+} trace_ring_t;
+
+int trace_active = 0;
+
+static char trace_path[512];
+static const char *trace_process = "";
+static trace_ring_t *trace_rings = NULL;    // every thread's ring, pushed lock-free
+static __thread trace_ring_t *thread_ring = NULL;
+
+int trace_open(const char *process_name) {
+    const char *path = getenv(TRACE_ENV);
+    if (!path || !*path) {
+        return 0;
+    }
+    if (strlen(path) >= sizeof(trace_path)) {
+        fprintf(stderr, "Trace path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(trace_path, path);
+    trace_process = process_name;
+    trace_active = 1;
+    printf("Tracing frame latency to %s\n", trace_path);
+    return 0;
+}
+
+static trace_ring_t *get_thread_ring(void) {
+    if (thread_ring) {
+        return thread_ring;
+    }
+
+    trace_ring_t *ring = (trace_ring_t*)calloc(1, sizeof(trace_ring_t));
+    if (!ring) {
+        return NULL;
+    }
+    ring->tid = syscall(SYS_gettid);
+
+    ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, 0,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    thread_ring = ring;
+    return ring;
+}
+
+uint64_t trace_timeval_us(const struct timeval *tv) {
+    return (uint64_t)tv->tv_sec * 1000000ULL + (uint64_t)tv->tv_usec;
+}
+
+uint64_t trace_now_us(void) {
+    if (!trace_active) {
+        return 0;
+    }
+    struct timeval now;
+    get_monotonic_time(&now);
+    return trace_timeval_us(&now);
+}
+
+uint64_t trace_rtp_time_us(uint32_t rtp_timestamp) {
+    uint64_t now_us = trace_now_us();
+    uint32_t age_ms = (uint32_t)(now_us / 1000) - rtp_timestamp;
+    if ((uint64_t)age_ms * 1000 > now_us) {
+        return now_us; // not from this host's clock
+    }
+    return now_us - (uint64_t)age_ms * 1000;
+}
+
+static void record(char phase, const char *name, uint32_t frame, uint64_t start_us,
+                   uint64_t end_us, uint64_t arg) {
+    trace_ring_t *ring = get_thread_ring();
+    if (!ring) {
+        return;
+    }
+    trace_event_t *event = &ring->events[ring->count % TRACE_RING_SIZE];
+    event->time_us = start_us;
+    event->duration_us = end_us > start_us ? end_us - start_us : 0;
+    event->name = name;
+    event->arg = arg;
+    event->frame = frame;
+    event->phase = phase;
+    ring->count++;
+}
+
+void trace_span(const char *name, uint32_t frame, uint64_t start_us, uint64_t arg) {
+    if (!trace_active) {
+        return;
+    }
+    record('b', name, frame, start_us, trace_now_us(), arg);
+}
+
+void trace_packet_span(const char *name, uint32_t frame, uint64_t seq, uint64_t start_us) {
+    if (!trace_active) {
+        return;
+    }
+    record('X', name, frame, start_us, trace_now_us(), seq);
+}
+
+void trace_instant(const char *name, uint32_t frame, uint64_t arg) {
+    if (!trace_active) {
+        return;
+    }
+    uint64_t now = trace_now_us();
+    record('n', name, frame, now, now, arg);
+}
+
+// Frame stages and instants become async events with the RTP timestamp as
+// id. Async events pair up by category and id, so each stage gets its own
+// category: a frame's stages may overlap, but one stage never overlaps itself.
+static void write_event(FILE *fp, trace_event_t *event, long tid) {
+    int pid = (int)getpid();
+    if (event->phase == 'X') {
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"packet\",\"ph\":\"X\",\"ts\":%" PRIu64
+                ",\"dur\":%" PRIu64 ",\"pid\":%d,\"tid\":%ld,\"args\":{\"frame\":%" PRIu32
+                ",\"seq\":%" PRIu64 "}}",
+                event->name, event->time_us, event->duration_us, pid, tid, event->frame, event->arg);
+        return;
+    }
+
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"id\":\"0x%08" PRIx32 "\","
+            "\"ts\":%" PRIu64 ",\"pid\":%d,\"tid\":%ld,\"args\":{\"frame\":%" PRIu32
+            ",\"arg\":%" PRIu64 "}}",
+            event->name, event->name, event->phase, event->frame, event->time_us, pid, tid,
+            event->frame, event->arg);
+    if (event->phase == 'b') {
+        fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"e\",\"id\":\"0x%08" PRIx32 "\","
+                "\"ts\":%" PRIu64 ",\"pid\":%d,\"tid\":%ld}",
+                event->name, event->name, event->frame, event->time_us + event->duration_us, pid, tid);
+    }
+}
+
+void trace_close(void) {
+    if (!trace_active) {
+        return;
+    }
+    trace_active = 0;
+
+    FILE *fp = fopen(trace_path, "w");
+    if (!fp) {
+        perror("Failed to write trace");
+        return;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}",
+            (int)getpid(), trace_process);
+    uint64_t written = 0, overwritten = 0;
+
+    trace_ring_t *ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+    while (ring) {
+        uint64_t start = ring->count > TRACE_RING_SIZE ? ring->count - TRACE_RING_SIZE : 0;
+        for (uint64_t i = start; i < ring->count; i++) {
+            write_event(fp, &ring->events[i % TRACE_RING_SIZE], ring->tid);
+        }
+        written += ring->count - start;
+        overwritten += start;
+
+        trace_ring_t *next = ring->next;
+        free(ring);
+        ring = next;
+    }
+    trace_rings = NULL;
+    thread_ring = NULL;
+
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    printf("Wrote %" PRIu64 " trace events to %s", written, trace_path);
+    if (overwritten > 0) {
+        printf(" (%" PRIu64 " oldest events overwritten)", overwritten);
+    }
+    printf("\n");
+}
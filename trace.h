@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#define TRACE_ENV "RTP_TRACE"          // output file; tracing is off when unset
+#define TRACE_RING_SIZE 65536          // events kept per thread, oldest overwritten first
+
+// Per-frame latency tracing. Every event is tagged with the RTP timestamp
+// of the frame it belongs to, recorded into a ring owned by the calling
+// thread and written out as Chrome trace-event JSON when the process exits
+// (open it in chrome://tracing or Perfetto). Server and client stamp events
+// with the same monotonic clock, so their files line up on one host.
+//
+// Event names must be string literals; only the pointer is recorded.
+
+extern int trace_active;
+
+// Enables tracing if RTP_TRACE is set. Returns -1 if it is set but the
+// trace cannot be set up.
+int trace_open(const char *process_name);
+
+// Writes every thread's ring to the trace file and disables tracing
+void trace_close(void);
+
+// Current trace clock in microseconds, 0 while tracing is off
+uint64_t trace_now_us(void);
+uint64_t trace_timeval_us(const struct timeval *tv);
+
+// When the sender stamped a frame, on the trace clock. The RTP timestamp is
+// the sender's monotonic clock in ms, so this only holds on one host.
+uint64_t trace_rtp_time_us(uint32_t rtp_timestamp);
+
+// A stage of a frame that started at start_us and ends now
+void trace_span(const char *name, uint32_t frame, uint64_t start_us, uint64_t arg);
+
+// A stage of a single packet (seq) within a frame. Packets overlap, so these
+// go on the thread's timeline rather than the frame's row.
+void trace_packet_span(const char *name, uint32_t frame, uint64_t seq, uint64_t start_us);
+
+// A point event, such as one packet arriving or being retransmitted
+void trace_instant(const char *name, uint32_t frame, uint64_t arg);
+
+#endif // TRACE_H
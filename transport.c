@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include "transport.h"
+#include "rtp.h"
+
+static int is_shm_spec(const char *spec) {
+    return strncmp(spec, SHM_PREFIX, strlen(SHM_PREFIX)) == 0;
+}
+
+// Both rings live in one segment: data ring first, feedback ring after it
+static int open_shm(transport_t *t, const char *spec, int create) {
+    size_t data_bytes = shm_ring_bytes(MAX_UDP_PAYLOAD, SHM_DATA_SLOTS);
+    data_bytes = (data_bytes + 63) & ~(size_t)63;
+    size_t feedback_bytes = shm_ring_bytes(SHM_FEEDBACK_SLOT_SIZE, SHM_FEEDBACK_SLOTS);
+
+    snprintf(t->shm_name, sizeof(t->shm_name), "/rtp_%s", spec + strlen(SHM_PREFIX));
+    t->shm_size = data_bytes + feedback_bytes;
+    t->shm_owner = create;
+
+    int fd = create ? shm_open(t->shm_name, O_CREAT | O_RDWR | O_TRUNC, 0600)
+                    : shm_open(t->shm_name, O_RDWR, 0);
+    if (fd < 0) {
+        perror(create ? "shm_open failed" : "shm_open failed (is the client running?)");
+        return -1;
+    }
+    if (create && ftruncate(fd, (off_t)t->shm_size) < 0) {
+        perror("ftruncate failed");
+        close(fd);
+        shm_unlink(t->shm_name);
+        return -1;
+    }
+
+    t->shm_base = mmap(NULL, t->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (t->shm_base == MAP_FAILED) {
+        perror("mmap failed");
+        t->shm_base = NULL;
+        if (create) shm_unlink(t->shm_name);
+        return -1;
+    }
+
+    shm_ring_t *data_ring = (shm_ring_t*)t->shm_base;
+    shm_ring_t *feedback_ring = (shm_ring_t*)((uint8_t*)t->shm_base + data_bytes);
+    if (create) {
+        shm_ring_init(data_ring, MAX_UDP_PAYLOAD, SHM_DATA_SLOTS);
+        shm_ring_init(feedback_ring, SHM_FEEDBACK_SLOT_SIZE, SHM_FEEDBACK_SLOTS);
+        t->rx = data_ring;
+        t->tx = feedback_ring;
+    } else {
+        t->tx = data_ring;
+        t->rx = feedback_ring;
+    }
+    t->type = TRANSPORT_SHM;
+    t->have_peer = 1;
+    return 0;
+}
+
+int transport_open_receiver(transport_t *t, const char *spec) {
+    memset(t, 0, sizeof(transport_t));
+    t->sockfd = -1;
+    if (is_shm_spec(spec)) {
+        return open_shm(t, spec, 1);
+    }
+
+    t->type = TRANSPORT_UDP;
+    t->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t->sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    struct sockaddr_in local_addr;
+    memset(&local_addr, 0, sizeof(local_addr));
+    local_addr.sin_family = AF_INET;
+    local_addr.sin_port = htons(atoi(spec));
+    local_addr.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(t->sockfd, (struct sockaddr*)&local_addr, sizeof(local_addr)) < 0) {
+        perror("Bind failed");
+        close(t->sockfd);
+        t->sockfd = -1;
+        return -1;
+    }
+    t->learn_peer = 1;
+    return 0;
+}
+
+int transport_open_sender(transport_t *t, const char *host, int port) {
+    memset(t, 0, sizeof(transport_t));
+    t->sockfd = -1;
+    if (is_shm_spec(host)) {
+        return open_shm(t, host, 0);
+    }
+
+    t->type = TRANSPORT_UDP;
+    t->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (t->sockfd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Oversized datagrams must be dropped, not fragmented, or probing
+    // would report any size as fitting the path
+    int pmtu_mode = IP_PMTUDISC_DO;
+    setsockopt(t->sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+
+    t->peer.sin_family = AF_INET;
+    t->peer.sin_port = htons(port);
+    t->peer.sin_addr.s_addr = inet_addr(host);
+    t->have_peer = 1;
+    return 0;
+}
+
+void transport_close(transport_t *t) {
+    if (t->type == TRANSPORT_SHM) {
+        if (t->shm_base) munmap(t->shm_base, t->shm_size);
+        if (t->shm_owner) shm_unlink(t->shm_name);
+        t->shm_base = NULL;
+    } else if (t->sockfd >= 0) {
+        close(t->sockfd);
+        t->sockfd = -1;
+    }
+}
+
+int transport_send(transport_t *t, const void *data, size_t len) {
+    if (t->type == TRANSPORT_SHM) {
+        return shm_ring_push(t->tx, data, len, SHM_PUSH_TIMEOUT_MS);
+    }
+    if (!t->have_peer) {
+        return 0; // nobody to answer yet
+    }
+    if (sendto(t->sockfd, data, len, 0, (struct sockaddr*)&t->peer, sizeof(t->peer)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t transport_recv(transport_t *t, void *buf, size_t cap, int timeout_ms) {
+    if (t->type == TRANSPORT_SHM) {
+        return shm_ring_pop(t->rx, buf, cap, timeout_ms);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = t->sockfd;
+    pfd.events = POLLIN;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    ssize_t len = recvfrom(t->sockfd, buf, cap, MSG_DONTWAIT, (struct sockaddr*)&from, &from_len);
+    if (len < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+
+    // The receiving side answers whoever sent last, as before. The sending
+    // side keeps the address it was opened with, so a stray datagram
+    // cannot redirect the stream.
+    if (t->learn_peer) {
+        t->peer = from;
+        t->have_peer = 1;
+    }
+    return len;
+}
+
+int transport_is_local(transport_t *t) {
+    return t->type == TRANSPORT_SHM;
+}
@@ -0,0 +1,58 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include "shm_ring.h"
+
+#define TRANSPORT_UDP 0
+#define TRANSPORT_SHM 1
+
+#define SHM_PREFIX "shm:"
+#define SHM_DATA_SLOTS 256          // server -> client datagrams
+#define SHM_FEEDBACK_SLOTS 256      // client -> server NACKs and acks
+#define SHM_FEEDBACK_SLOT_SIZE 64
+#define SHM_PUSH_TIMEOUT_MS 20      // how long a full ring may stall the sender
+
+// Datagram path between server and client. UDP is the network path; SHM
+// is a pair of shared-memory rings for a server and client on the same
+// host, carrying exactly the same datagrams without the network stack.
+typedef struct {
+    int type;
+
+    // UDP
+    int sockfd;
+    struct sockaddr_in peer;
+    int have_peer;              // the client learns the server from its datagrams
+    int learn_peer;             // receiving side: answer whoever sent last
+
+    // SHM: the client creates the segment, the server attaches to it
+    void *shm_base;
+    size_t shm_size;
+    char shm_name[64];
+    int shm_owner;
+    shm_ring_t *tx;
+    shm_ring_t *rx;
+} transport_t;
+
+// spec is a port number, or shm:<name> for a same-host shared-memory ring
+int transport_open_receiver(transport_t *t, const char *spec);
+
+// host is an IPv4 address with port, or shm:<name> (port ignored)
+int transport_open_sender(transport_t *t, const char *host, int port);
+
+void transport_close(transport_t *t);
+
+// Returns 0, or -1 with errno set (EMSGSIZE for oversized datagrams)
+int transport_send(transport_t *t, const void *data, size_t len);
+
+// Waits up to timeout_ms (0 only polls) for a datagram. Returns its length,
+// 0 on timeout, -1 on error or signal.
+ssize_t transport_recv(transport_t *t, void *buf, size_t cap, int timeout_ms);
+
+// Lossless local path: no pacing or retransmission waits are needed
+int transport_is_local(transport_t *t);
+
+#endif // TRANSPORT_H